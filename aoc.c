@@ -1,3 +1,4 @@
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -6,20 +7,56 @@
 
 
 #ifdef _MSC_VER
+#include <direct.h>
+#include <sys/stat.h>
 #define strcasecmp _stricmp
+#define strncasecmp _strnicmp
+#define mkdir(p, m) _mkdir(p)
 #else
 #include <strings.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define X86_KERNELS
+#define TARGET(f)        __attribute__((target(f)))
 #endif
 
 #define FILENAME         ".aoc"
+#define HISTFILE         FILENAME ".hist"
+#define HOMEDIR          ".aoc.d"
+#define MANIFEST         "manifest"
+#define PATH_SZ          4096
 #define YEAR(n)          (2015 + (n))
-#define print_all()      (print(UINT64_MAX, UINT64_MAX, UINT32_MAX))
+#define print_all()      (print(NULL, UINT64_MAX, UINT32_MAX))
+#define IO_BUF_SZ        (1 << 16)
+#define BATCH_SZ         1024
+#define SCAN_SZ          1024
 
 #define MASK(n)          (((uint64_t) 1) << ((n) % 64))
 #define SET(b, n)        ((b) |= MASK(n))
 #define CLEAR(b, n)      ((b) &= ~MASK(n))
 #define IS_SET(b, n)     ((b) & MASK(n))
 #define WORD(l, y)       ((l)->bits[y])
+#define LANG_SET(b, n)   (!(b) || (((b)[(n) / 64] >> ((n) % 64)) & 1))
+#define DAY_BITS         UINT64_C(0x0001555555555555)
+#define ALL_DAYS         UINT32_C(0x1FFFFFF)
+#define QUERY_MAX_OPS    128
+#define UNDO_SZ          4096
+#define RECENT_SZ        64
+#define RECENT_PENALTY   16
+#define PICK_KEY(p)      ((uint64_t) (p).lang << 16 | (p).year << 8 | (p).day)
+#define UNDO_AT(i)       (&undo_ring[(undo_base + (i)) % UNDO_SZ])
+
+/* history tuples: 17 bits name, 8 bits year, 5 bits day, 2 bits state */
+#define HIST_MAX_NAMES   (1 << 17)
+#define HIST_CHUNK       (1 << 16)
+#define TUPLE(n, y, d, s) ((uint32_t) (n) << 15 | (uint32_t) (y) << 7 | (d) << 2 | (s))
+#define T_NAME(t)        ((t) >> 15)
+#define T_YEAR(t)        (((t) >> 7) & 0xFF)
+#define T_DAY(t)         (((t) >> 2) & 0x1F)
+#define T_STATE(t)       ((t) & 2 ? COMPLETED : (t) & 1 ? STARTED : NOT_YET)
 
 #define str_eq1(a, b)    (!strcasecmp((a), (b)))
 #define str_eq2(a, b, c) (str_eq1(a, b) || (str_eq1(a, c)))
@@ -36,29 +73,140 @@ typedef enum {
 typedef struct {
     char *name;
     uint64_t *bits;
+    uint32_t hist_id; /* index + 1 in hist_names, 0 if not looked up yet */
 } lang;
 
 
+char filename[PATH_SZ] = FILENAME;
+char histname[PATH_SZ + 8] = HISTFILE;
+char home[PATH_SZ / 2] = "";
+char profile[UINT8_MAX + 1] = "";
 lang *langs = NULL;
 size_t langs_sz = 0;
 size_t alloc_sz = 0;
 uint8_t max_year = 0;
 int edit_mode = 0;
+int quiet = 0;
+int exit_status = EXIT_SUCCESS;
 
 
 /* utils */
 
+/* index of the first language whose name is not before s */
+int lower_bound(const char *s) {
+    int lo = 0, hi = langs_sz;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strcasecmp(langs[mid].name, s) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+
 int index_of(const char *s) {
-    int i = 0, n = -1;
-    for (; i < langs_sz && (n = strcasecmp(langs[i].name, s)) < 0; ++i);
-    return n ? -1 : i;
+    int i = lower_bound(s);
+    return i < langs_sz && !strcasecmp(langs[i].name, s) ? i : -1;
 }
 
 
 int estimate_index_of(const char *s) {
-    int i = 0, n = -1;
-    for (; i < langs_sz && (n = strcasecmp(langs[i].name, s)) < 0; ++i);
-    return n ? i : -1;
+    int i = lower_bound(s);
+    return i < langs_sz && !strcasecmp(langs[i].name, s) ? -1 : i;
+}
+
+
+/* range [lo, hi) of the languages starting with the n first characters of s */
+void prefix_range(const char *s, size_t n, int *lo, int *hi) {
+    char z[UINT8_MAX + 1];
+    snprintf(z, sizeof(z), "%.*s", (int) n, s);
+    *lo = lower_bound(z);
+    int a = *lo, b = langs_sz;
+    while (a < b) {
+        int mid = a + (b - a) / 2;
+        if (!strncasecmp(langs[mid].name, z, n))
+            a = mid + 1;
+        else
+            b = mid;
+    }
+    *hi = a;
+}
+
+
+/* case insensitive match of s against a pattern with '*' and '?' wildcards */
+int glob_match(const char *p, const char *s) {
+    const char *star = NULL, *back = NULL;
+    while (*s) {
+        if (*p == '*') {
+            star = ++p;
+            back = s;
+        } else if (*p == '?' || tolower((unsigned char) *p) == tolower((unsigned char) *s)) {
+            p++;
+            s++;
+        } else if (star) {
+            p = star;
+            s = ++back;
+        } else
+            return 0;
+    }
+    while (*p == '*')
+        p++;
+    return !*p;
+}
+
+
+/* sets the bits [lo, hi) a word at a time */
+void set_range(uint64_t *b, size_t lo, size_t hi) {
+    while (lo < hi) {
+        size_t off = lo % 64, n = hi - lo < 64 - off ? hi - lo : 64 - off;
+        b[lo / 64] |= (n == 64 ? UINT64_MAX : (UINT64_C(1) << n) - 1) << off;
+        lo += n;
+    }
+}
+
+
+/* sets the bits of the languages matching the name, prefix or glob pattern */
+void select_langs(uint64_t *b, const char *pattern) {
+    size_t n = strcspn(pattern, "*?");
+    if (!pattern[n]) {
+        int i = index_of(pattern);
+        if (i >= 0)
+            set_range(b, i, i + 1);
+        return;
+    }
+
+    int lo, hi;
+    prefix_range(pattern, n, &lo, &hi);
+    if (!strcmp(&pattern[n], "*")) {
+        set_range(b, lo, hi);
+        return;
+    }
+    for (int i = lo; i < hi; ++i)
+        if (glob_match(&pattern[n], &langs[i].name[n]))
+            set_range(b, i, i + 1);
+}
+
+
+uint32_t hash_name(const char *s) {
+    uint32_t h = 2166136261u;
+    for (; *s; ++s)
+        h = (h ^ (unsigned char) tolower(*s)) * 16777619u;
+    return h;
+}
+
+
+int popcount(uint64_t x) {
+    x -= (x >> 1) & UINT64_C(0x5555555555555555);
+    x = (x & UINT64_C(0x3333333333333333)) + ((x >> 2) & UINT64_C(0x3333333333333333));
+    x = (x + (x >> 4)) & UINT64_C(0x0F0F0F0F0F0F0F0F);
+    return (x * UINT64_C(0x0101010101010101)) >> 56;
+}
+
+
+const char *state_name(state s) {
+    return s == COMPLETED ? "completed" : s == STARTED ? "started" : "not_yet";
 }
 
 
@@ -80,16 +228,27 @@ void free_lang(lang *l) {
 }
 
 
+/* moves langs[from] to langs[to], shifting the languages in between */
+void move_lang(int from, int to) {
+    lang l = langs[from];
+    if (from < to)
+        memmove(&langs[from], &langs[from + 1], (to - from) * sizeof(lang));
+    else if (from > to)
+        memmove(&langs[to + 1], &langs[to], (from - to) * sizeof(lang));
+    langs[to] = l;
+}
+
+
 void clean_all() {
+    if (langs) {
+        for (size_t i = 0; i < alloc_sz; ++i)
+            free_lang(&langs[i]);
+        free(langs);
+        langs = NULL;
+    }
     max_year = 0;
     langs_sz = 0;
     alloc_sz = 0;
-    if (!langs)
-        return;
-    for (size_t i = 0; i < langs_sz; ++i)
-        free_lang(&langs[i]);
-    free_lang(langs);
-    langs = NULL;
 }
 
 
@@ -107,6 +266,7 @@ int resize_langs(size_t new_sz) {
         return 1;
     }
 
+    size_t old_alloc = alloc_sz;
     if (new_sz > alloc_sz) {
         lang *ptr = realloc(langs, new_sz * sizeof(lang));
         if (!ptr) {
@@ -118,6 +278,8 @@ int resize_langs(size_t new_sz) {
     }
 
     for (size_t i = langs_sz; i < new_sz; ++i) {
+        if (i < old_alloc)
+            free(langs[i].bits);
         langs[i] = (lang) { NULL, NULL };
         if (max_year) {
             langs[i].bits = calloc(max_year, sizeof(uint64_t));
@@ -134,326 +296,2680 @@ int resize_langs(size_t new_sz) {
 }
 
 
-/* data */
+/* history */
 
-state get_state(const lang *lang, int year, int day) {
-    uint64_t word = WORD(lang, year);
-    day <<= 1;
-    if (IS_SET(word, day))
-        return COMPLETED;
-    else if (IS_SET(word, day + 1))
-        return STARTED;
-    else
-        return NOT_YET;
+typedef struct {
+    int64_t time;
+    uint32_t name;
+    uint8_t year, day, state;
+} hist_event;
+
+
+typedef struct {
+    char **names;
+    size_t names_sz, names_alloc;
+    int64_t *times;
+    uint32_t *tuples;
+    size_t sz, alloc;
+    int64_t last; /* time of the last event of the file */
+} history;
+
+
+/* open addressing table of indices into an array of names, case insensitive */
+typedef struct {
+    uint32_t *slots;
+    size_t cap;
+} name_table;
+
+
+/*
+ * Unsaved transitions, names are indices into hist_names. Past HIST_CHUNK
+ * events, they are moved to the temporary file hist_spill.
+ */
+hist_event *hist = NULL;
+size_t hist_sz = 0, hist_alloc = 0;
+FILE *hist_spill = NULL;
+size_t hist_spilled = 0;
+char **hist_names = NULL;
+size_t hist_names_sz = 0, hist_names_alloc = 0;
+name_table hist_table = { NULL, 0 };
+
+
+int grow(void **ptr, size_t *alloc, size_t need, size_t elem) {
+    if (need <= *alloc)
+        return 1;
+    size_t n = *alloc ? *alloc : 16;
+    while (n < need)
+        n *= 2;
+    void *p = realloc(*ptr, n * elem);
+    if (!p) {
+        puts("Allocation error: OOM.");
+        return 0;
+    }
+    *ptr = p;
+    *alloc = n;
+    return 1;
 }
 
 
-void set_state(const lang *lang, int year, int day, state state) {
-    uint64_t *word = &WORD(lang, year);
-    int i = day << 1;
-    if (state == COMPLETED) {
-        SET(*word, i);
-        CLEAR(*word, i + 1);
-        printf("Completed %d %02d %s.\n", YEAR(year), day, lang->name);
-    } else if (state == STARTED) {
-        SET(*word, i + 1);
-        CLEAR(*word, i);
-        printf("Started %d %02d %s.\n", YEAR(year), day, lang->name);
-    } else {
-        CLEAR(*word, i);
-        CLEAR(*word, i + 1);
-        printf("Cleared %d %02d %s.\n", YEAR(year), day, lang->name);
+int push_name(char ***names, size_t *sz, size_t *alloc, const char *name) {
+    char *z = malloc(strlen(name) + 1);
+    if (!z || !grow((void **) names, alloc, *sz + 1, sizeof(char *))) {
+        if (!z)
+            puts("Allocation error: OOM.");
+        free(z);
+        return 0;
+    }
+    strcpy(z, name);
+    (*names)[(*sz)++] = z;
+    return 1;
+}
+
+
+/* index of the name in names, or -1 */
+long name_find(const name_table *t, char **names, const char *name) {
+    if (!t->cap)
+        return -1;
+    for (size_t i = hash_name(name) & (t->cap - 1);; i = (i + 1) & (t->cap - 1)) {
+        if (!t->slots[i])
+            return -1;
+        if (!strcasecmp(names[t->slots[i] - 1], name))
+            return t->slots[i] - 1;
     }
 }
 
 
-int new_year() {
-    if (max_year == UINT8_MAX) {
+/* adds names[n], growing the table to keep it at most half full */
+int name_add(name_table *t, char **names, size_t n) {
+    if (2 * (n + 1) > t->cap) {
+        size_t cap = t->cap ? 2 * t->cap : 64;
+        uint32_t *slots = calloc(cap, sizeof(uint32_t));
+        if (!slots) {
+            puts("Allocation error: OOM.");
+            return 0;
+        }
+        free(t->slots);
+        t->slots = slots;
+        t->cap = cap;
+        for (size_t i = 0; i < n; ++i)
+            name_add(t, names, i);
+    }
+    size_t i = hash_name(names[n]) & (t->cap - 1);
+    while (t->slots[i])
+        i = (i + 1) & (t->cap - 1);
+    t->slots[i] = n + 1;
+    return 1;
+}
+
+
+void hist_clear() {
+    for (size_t i = 0; i < hist_names_sz; ++i)
+        free(hist_names[i]);
+    free(hist_names);
+    free(hist);
+    free(hist_table.slots);
+    if (hist_spill)
+        fclose(hist_spill);
+    hist_names = NULL;
+    hist = NULL;
+    hist_table = (name_table) { NULL, 0 };
+    hist_spill = NULL;
+    hist_names_sz = hist_names_alloc = 0;
+    hist_sz = hist_alloc = hist_spilled = 0;
+}
+
+
+void hist_push(lang *l, int year, int day, state s) {
+    long n = (long) l->hist_id - 1;
+    if (n < 0 || (size_t) n >= hist_names_sz) {
+        n = name_find(&hist_table, hist_names, l->name);
+        if (n < 0) {
+            n = hist_names_sz;
+            if (!push_name(&hist_names, &hist_names_sz, &hist_names_alloc, l->name))
+                return;
+            if (!name_add(&hist_table, hist_names, n)) {
+                free(hist_names[--hist_names_sz]);
+                return;
+            }
+        }
+        l->hist_id = n + 1;
+    }
+
+    /* if there is no temporary file, the events just stay in memory */
+    if (hist_sz == HIST_CHUNK && (hist_spill || (hist_spill = tmpfile()))) {
+        if (fwrite(hist, sizeof(hist_event), hist_sz, hist_spill) == hist_sz) {
+            hist_spilled += hist_sz;
+            hist_sz = 0;
+        }
+    }
+
+    if (!grow((void **) &hist, &hist_alloc, hist_sz + 1, sizeof(hist_event)))
+        return;
+    hist[hist_sz++] = (hist_event) {
+        time(NULL), n, year, day, s == COMPLETED ? 2 : s == STARTED
+    };
+}
+
+
+/* records the transition of every day that differs between both words */
+void hist_word(lang *l, int year, uint64_t old, uint64_t new) {
+    for (int d = 0; d < 25; ++d) {
+        int a = (old >> (d << 1)) & 3, b = (new >> (d << 1)) & 3;
+        if (a != b)
+            hist_push(l, year, d, b & 1 ? COMPLETED : b ? STARTED : NOT_YET);
+    }
+}
+
+
+void hist_free(history *h) {
+    for (size_t i = 0; i < h->names_sz; ++i)
+        free(h->names[i]);
+    free(h->names);
+    free(h->times);
+    free(h->tuples);
+    *h = (history) { NULL, 0, 0, NULL, NULL, 0, 0, 0 };
+}
+
+
+size_t put_varint(uint8_t *z, uint64_t v) {
+    size_t n = 0;
+    do {
+        z[n++] = (v & 0x7F) | (v > 0x7F ? 0x80 : 0);
+        v >>= 7;
+    } while (v);
+    return n;
+}
+
+
+/* reads a varint of at most *budget bytes (if budget is not NULL) */
+int read_varint(FILE *fp, uint64_t *v, uint64_t *budget) {
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c;
+        if ((budget && !(*budget)--) || (c = fgetc(fp)) == EOF)
+            return 0;
+        *v |= (uint64_t) (c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return 1;
+    }
+    return 0;
+}
+
+
+/*
+ * Loads the history file. Events are only kept if events is set, otherwise
+ * only the language names and the time of the last event are read. A missing
+ * file is empty.
+ */
+int hist_load(history *h, int events) {
+    FILE *fp = fopen(histname, "rb");
+    if (!fp)
+        return 1;
+
+    char name[UINT8_MAX + 1];
+    int c;
+    while ((c = fgetc(fp)) != EOF) {
+        if (c == 'N') {
+            int n = fgetc(fp);
+            if (n == EOF || fread(name, 1, n, fp) != (size_t) n)
+                goto invalid_file;
+            name[n] = '\0';
+            if (!push_name(&h->names, &h->names_sz, &h->names_alloc, name))
+                goto failure;
+            continue;
+        }
+
+        uint64_t count, dsz, v;
+        if (c != 'E' || !read_varint(fp, &count, NULL) || !read_varint(fp, &dsz, NULL)
+            || count > UINT32_MAX)
+            goto invalid_file;
+
+        if (events) {
+            if (!grow((void **) &h->times, &h->alloc, h->sz + count, sizeof(int64_t)))
+                goto failure;
+            uint32_t *p = realloc(h->tuples, h->alloc * sizeof(uint32_t));
+            if (!p) {
+                puts("Allocation error: OOM.");
+                goto failure;
+            }
+            h->tuples = p;
+        }
+
+        /* zigzag encoded varint deltas, continuing from the previous block */
+        for (uint64_t i = 0; i < count; ++i) {
+            if (!read_varint(fp, &v, &dsz))
+                goto invalid_file;
+            h->last += (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+            if (events)
+                h->times[h->sz + i] = h->last;
+        }
+        if (dsz)
+            goto invalid_file;
+        if (!events) {
+            if (fseek(fp, count * (long) sizeof(uint32_t), SEEK_CUR))
+                goto invalid_file;
+            continue;
+        }
+        if (fread(&h->tuples[h->sz], sizeof(uint32_t), count, fp) != count)
+            goto invalid_file;
+        h->sz += count;
+    }
+
+    fclose(fp);
+    return 1;
+
+    invalid_file:
+    printf("Error reading history: '%s' contains invalid data.\n", histname);
+    failure:
+    fclose(fp);
+    hist_free(h);
+    return 0;
+}
+
+
+/* writes an event block, names being mapped by ids (-1 if not recorded) */
+int hist_block(FILE *fp, const hist_event *e, size_t n, const long *ids, uint8_t *deltas,
+               int64_t *last, size_t *dropped) {
+    uint8_t head[20];
+    uint32_t dsz = 0, count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (ids[e[i].name] < 0) {
+            ++*dropped;
+            continue;
+        }
+        int64_t d = e[i].time - *last;
+        *last = e[i].time;
+        count++;
+        dsz += put_varint(&deltas[dsz], ((uint64_t) d << 1) ^ (uint64_t) (d >> 63));
+    }
+    if (!count)
+        return 1;
+
+    size_t hsz = put_varint(head, count);
+    hsz += put_varint(&head[hsz], dsz);
+    if (fputc('E', fp) == EOF
+        || fwrite(head, 1, hsz, fp) != hsz
+        || fwrite(deltas, 1, dsz, fp) != dsz)
+        return 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        if (ids[e[i].name] < 0)
+            continue;
+        uint32_t tuple = TUPLE(ids[e[i].name], e[i].year, e[i].day, e[i].state);
+        if (!fwrite(&tuple, sizeof(tuple), 1, fp))
+            return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * Appends the unsaved transitions to the history file. Languages past the
+ * first HIST_MAX_NAMES ever recorded have their transitions dropped.
+ */
+int hist_flush() {
+    if (!hist_sz && !hist_spilled)
+        return 1;
+
+    history h = { NULL, 0, 0, NULL, NULL, 0, 0, 0 };
+    name_table table = { NULL, 0 };
+    long *ids = malloc(hist_names_sz * sizeof(long));
+    uint8_t *deltas = malloc(HIST_CHUNK * 10);
+    hist_event *chunk = hist_spilled ? malloc(HIST_CHUNK * sizeof(hist_event)) : NULL;
+    size_t dropped = 0;
+    FILE *fp = NULL;
+    int ok = 0;
+
+    if (!ids || !deltas || (hist_spilled && !chunk)) {
+        puts("Allocation error: OOM.");
+        goto end;
+    }
+    /* more events than HIST_CHUNK if they could not be spilled */
+    if (hist_sz > HIST_CHUNK) {
+        uint8_t *p = realloc(deltas, hist_sz * 10);
+        if (!p) {
+            puts("Allocation error: OOM.");
+            goto end;
+        }
+        deltas = p;
+    }
+    if (!hist_load(&h, 0))
+        goto end;
+    for (size_t i = 0; i < h.names_sz; ++i)
+        if (!name_add(&table, h.names, i))
+            goto end;
+
+    fp = fopen(histname, "ab");
+    if (!fp) {
+        printf("Error saving history: '%s' could not be opened.\n", histname);
+        goto end;
+    }
+
+    for (size_t i = 0; i < hist_names_sz; ++i) {
+        long n = name_find(&table, h.names, hist_names[i]);
+        if (n < 0 && h.names_sz < HIST_MAX_NAMES) {
+            n = h.names_sz;
+            uint8_t sz = strlen(hist_names[i]);
+            if (fputc('N', fp) == EOF || fputc(sz, fp) == EOF
+                || fwrite(hist_names[i], 1, sz, fp) != sz)
+                goto write_error;
+            if (!push_name(&h.names, &h.names_sz, &h.names_alloc, hist_names[i])
+                || !name_add(&table, h.names, n))
+                goto end;
+        }
+        ids[i] = n;
+    }
+
+    int64_t last = h.last;
+    if (hist_spilled) {
+        rewind(hist_spill);
+        for (size_t i = 0; i < hist_spilled; i += HIST_CHUNK) {
+            size_t n = hist_spilled - i < HIST_CHUNK ? hist_spilled - i : HIST_CHUNK;
+            if (fread(chunk, sizeof(hist_event), n, hist_spill) != n) {
+                puts("Error saving history: could not read the temporary file.");
+                goto end;
+            }
+            if (!hist_block(fp, chunk, n, ids, deltas, &last, &dropped))
+                goto write_error;
+        }
+    }
+    if (!hist_block(fp, hist, hist_sz, ids, deltas, &last, &dropped))
+        goto write_error;
+
+    if (dropped)
         printf(
-            "Error adding new year: maximum year is %u (%u).\n",
-            UINT8_MAX, YEAR(UINT8_MAX)
+            "Warning: history is limited to %d languages, %lu change(s) to "
+            "other languages were not recorded.\n",
+            HIST_MAX_NAMES, (unsigned long) dropped
         );
+    if (hist_spill)
+        fclose(hist_spill);
+    hist_spill = NULL;
+    hist_sz = hist_spilled = 0;
+    ok = 1;
+    goto end;
+
+    write_error:
+    printf("Error saving history: could not write to '%s'.\n", histname);
+    end:
+    if (fp)
+        fclose(fp);
+    hist_free(&h);
+    free(table.slots);
+    free(ids);
+    free(deltas);
+    free(chunk);
+    return ok;
+}
+
+
+int64_t *sort_times;
+
+
+int cmp_events(const void *a, const void *b) {
+    size_t i = *(const size_t *) a, j = *(const size_t *) b;
+    if (sort_times[i] != sort_times[j])
+        return (sort_times[i] > sort_times[j]) - (sort_times[i] < sort_times[j]);
+    return (i > j) - (i < j);
+}
+
+
+/* sorts the events by time in case the clock went backwards between saves */
+int hist_sort(history *h) {
+    size_t i = 1;
+    for (; i < h->sz && h->times[i - 1] <= h->times[i]; ++i);
+    if (i >= h->sz)
+        return 1;
+
+    size_t *idx = malloc(h->sz * sizeof(size_t));
+    int64_t *times = malloc(h->sz * sizeof(int64_t));
+    uint32_t *tuples = malloc(h->sz * sizeof(uint32_t));
+    if (!idx || !times || !tuples) {
+        puts("Allocation error: OOM.");
+        free(idx);
+        free(times);
+        free(tuples);
         return 0;
     }
 
-    for (int i = 0; i < langs_sz; ++i) {
-        uint64_t *ptr = realloc(langs[i].bits, (max_year + 1) * sizeof(uint64_t));
-        if (!ptr) {
-            puts("Error adding new year: OOM.");
+    for (i = 0; i < h->sz; ++i)
+        idx[i] = i;
+    sort_times = h->times;
+    qsort(idx, h->sz, sizeof(size_t), cmp_events);
+    for (i = 0; i < h->sz; ++i) {
+        times[i] = h->times[idx[i]];
+        tuples[i] = h->tuples[idx[i]];
+    }
+
+    free(idx);
+    free(h->times);
+    free(h->tuples);
+    h->times = times;
+    h->tuples = tuples;
+    h->alloc = h->sz;
+    return 1;
+}
+
+
+/* index of the first event at or after t */
+size_t hist_lower_bound(const history *h, int64_t t) {
+    size_t lo = 0, hi = h->sz;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (h->times[mid] < t)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+
+/* days since 1970-01-01 of the given (proleptic gregorian) date */
+int64_t days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+
+void print_date(int64_t t, const char *fmt) {
+    char z[32];
+    time_t tt = t;
+    struct tm *tm = gmtime(&tt);
+    if (tm && strftime(z, sizeof(z), fmt, tm))
+        fputs(z, stdout);
+    else
+        printf("%lld", (long long) t);
+}
+
+
+void print_duration(int64_t t) {
+    printf(
+        "%lldd %02lldh %02lldm", (long long) (t / 86400),
+        (long long) (t % 86400 / 3600), (long long) (t % 3600 / 60)
+    );
+}
+
+
+void hist_log(const history *h, size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; ++i) {
+        uint32_t t = h->tuples[i];
+        print_date(h->times[i], "%Y-%m-%d %H:%M");
+        printf(
+            "  %-9s %d %02d %s\n", state_name(T_STATE(t)),
+            YEAR(T_YEAR(t)), T_DAY(t) + 1, h->names[T_NAME(t)]
+        );
+    }
+}
+
+
+void hist_weekly(const history *h, size_t lo, size_t hi) {
+    int64_t week = INT64_MIN;
+    long n = 0;
+
+    /* weeks start on monday, 1970-01-01 was a thursday */
+    for (size_t i = lo; i <= hi; ++i) {
+        int64_t w = INT64_MAX;
+        if (i < hi) {
+            if (T_STATE(h->tuples[i]) != COMPLETED)
+                continue;
+            int64_t days = h->times[i] / 86400 - (h->times[i] % 86400 < 0);
+            w = days - ((days + 3) % 7 + 7) % 7;
+        }
+        if (w != week && n) {
+            print_date(week * 86400, "Week of %Y-%m-%d");
+            printf(": %ld completed\n", n);
+            n = 0;
+        }
+        week = w;
+        n++;
+    }
+}
+
+
+uint32_t *sort_tuples;
+
+
+int cmp_keys(const void *a, const void *b) {
+    size_t i = *(const size_t *) a, j = *(const size_t *) b;
+    uint32_t x = sort_tuples[i] & ~3u, y = sort_tuples[j] & ~3u;
+    if (x != y)
+        return (x > y) - (x < y);
+    return (i > j) - (i < j);
+}
+
+
+/* time from the first start to the completion of each day completed in range */
+void hist_time(const history *h, int64_t from, int64_t to) {
+    if (!h->sz) {
+        puts("No started then completed day found.");
+        return;
+    }
+    size_t *idx = malloc(h->sz * sizeof(size_t));
+    if (!idx) {
+        puts("Allocation error: OOM.");
+        return;
+    }
+    for (size_t i = 0; i < h->sz; ++i)
+        idx[i] = i;
+    sort_tuples = h->tuples;
+    qsort(idx, h->sz, sizeof(size_t), cmp_keys);
+
+    int64_t total = 0, start = -1;
+    long n = 0;
+    for (size_t k = 0; k < h->sz; ++k) {
+        size_t i = idx[k];
+        uint32_t t = h->tuples[i];
+        if (k && (h->tuples[idx[k - 1]] & ~3u) != (t & ~3u))
+            start = -1;
+
+        if (T_STATE(t) == STARTED) {
+            if (start < 0)
+                start = h->times[i];
+            continue;
+        }
+        if (T_STATE(t) == COMPLETED && start >= 0
+            && h->times[i] >= from && h->times[i] < to) {
+            printf(
+                "%d %02d %s: ",
+                YEAR(T_YEAR(t)), T_DAY(t) + 1, h->names[T_NAME(t)]
+            );
+            print_duration(h->times[i] - start);
+            putchar('\n');
+            total += h->times[i] - start;
+            n++;
+        }
+        start = -1;
+    }
+
+    if (n) {
+        printf("Average over %ld completions: ", n);
+        print_duration(total / n);
+        putchar('\n');
+    } else
+        puts("No started then completed day found.");
+    free(idx);
+}
+
+
+/* undo */
+
+typedef enum {
+    U_WORD,
+    U_ADD,
+    U_REMOVE,
+    U_RENAME,
+    U_YEAR_ADD,
+    U_YEAR_RM
+} undo_type;
+
+
+typedef struct {
+    undo_type type;
+    unsigned step;      /* edit mode command the delta belongs to */
+    int index, to;      /* language index, and index after a rename */
+    int year;
+    uint64_t xor;       /* changed bits of the word */
+    lang l;             /* removed language or replaced name, owned */
+} delta;
+
+
+/* undoable deltas followed by redoable ones, starting at undo_base */
+delta undo_ring[UNDO_SZ];
+size_t undo_base = 0, undo_len = 0, redo_len = 0;
+unsigned undo_step = 0, undo_dropped = 0;
+int undo_replay = 0;
+
+
+void undo_clear() {
+    for (size_t i = 0; i < undo_len + redo_len; ++i)
+        free_lang(&UNDO_AT(i)->l);
+    undo_base = undo_len = redo_len = 0;
+}
+
+
+/* takes ownership of d.l */
+void undo_push(delta d) {
+    if (!edit_mode || undo_replay || undo_step == undo_dropped) {
+        free_lang(&d.l);
+        return;
+    }
+    d.step = undo_step;
+
+    for (; redo_len; --redo_len)
+        free_lang(&UNDO_AT(undo_len + redo_len - 1)->l);
+
+    if (d.type == U_WORD && undo_len) {
+        delta *top = UNDO_AT(undo_len - 1);
+        if (top->type == U_WORD && top->step == d.step
+            && top->index == d.index && top->year == d.year) {
+            top->xor ^= d.xor;
+            return;
+        }
+    }
+
+    if (undo_len == UNDO_SZ) {
+        /* drop the oldest command, or this one if it is too large to undo */
+        unsigned step = UNDO_AT(0)->step;
+        if (step == d.step) {
+            undo_clear();
+            undo_dropped = d.step;
+            free_lang(&d.l);
+            return;
+        }
+        for (; undo_len && UNDO_AT(0)->step == step; --undo_len) {
+            free_lang(&UNDO_AT(0)->l);
+            undo_base = (undo_base + 1) % UNDO_SZ;
+        }
+    }
+
+    *UNDO_AT(undo_len++) = d;
+}
+
+
+/* moves langs[d->index] to d->l */
+void take_lang(delta *d) {
+    d->l = langs[d->index];
+    langs_sz--;
+    memmove(&langs[d->index], &langs[d->index + 1], (langs_sz - d->index) * sizeof(lang));
+    langs[langs_sz] = (lang) { NULL, NULL };
+}
+
+
+/* moves d->l back to langs[d->index] */
+int put_lang(delta *d) {
+    if (langs_sz == alloc_sz) {
+        lang *ptr = realloc(langs, (alloc_sz + 1) * sizeof(lang));
+        if (!ptr) {
+            puts("Allocation error: OOM.");
+            return 0;
+        }
+        alloc_sz++;
+        langs = ptr;
+    } else
+        free_lang(&langs[langs_sz]);
+
+    memmove(&langs[d->index + 1], &langs[d->index], (langs_sz - d->index) * sizeof(lang));
+    langs[d->index] = d->l;
+    langs_sz++;
+    d->l = (lang) { NULL, NULL };
+    return 1;
+}
+
+
+static inline void swap_name(delta *d) {
+    char *z = langs[d->to].name;
+    langs[d->to].name = d->l.name;
+    langs[d->to].hist_id = 0;
+    d->l.name = z;
+}
+
+
+int undo_apply(delta *d, int undo) {
+    switch (d->type) {
+        case U_WORD: {
+            lang *l = &langs[d->index];
+            uint64_t old = WORD(l, d->year);
+            WORD(l, d->year) ^= d->xor;
+            hist_word(l, d->year, old, WORD(l, d->year));
+            return 1;
+        }
+        case U_ADD:
+        case U_REMOVE:
+            if (undo == (d->type == U_ADD)) {
+                take_lang(d);
+                return 1;
+            }
+            return put_lang(d);
+        case U_RENAME:
+            if (undo) {
+                swap_name(d);
+                move_lang(d->to, d->index);
+            } else {
+                move_lang(d->index, d->to);
+                swap_name(d);
+            }
+            return 1;
+        case U_YEAR_ADD:
+        case U_YEAR_RM:
+            if (undo == (d->type == U_YEAR_ADD))
+                max_year--;
+            else
+                max_year++;
+            return 1;
+    }
+    return 0;
+}
+
+
+/* data */
+
+state get_state(const lang *lang, int year, int day) {
+    uint64_t word = WORD(lang, year);
+    day <<= 1;
+    if (IS_SET(word, day))
+        return COMPLETED;
+    else if (IS_SET(word, day + 1))
+        return STARTED;
+    else
+        return NOT_YET;
+}
+
+
+void set_state(lang *lang, int year, int day, state state) {
+    uint64_t *word = &WORD(lang, year);
+    uint64_t old = *word;
+    int i = day << 1;
+    if (get_state(lang, year, day) != state)
+        hist_push(lang, year, day, state);
+    if (state == COMPLETED) {
+        SET(*word, i);
+        CLEAR(*word, i + 1);
+        if (!quiet)
+            printf("Completed %d %02d %s.\n", YEAR(year), day, lang->name);
+    } else if (state == STARTED) {
+        SET(*word, i + 1);
+        CLEAR(*word, i);
+        if (!quiet)
+            printf("Started %d %02d %s.\n", YEAR(year), day, lang->name);
+    } else {
+        CLEAR(*word, i);
+        CLEAR(*word, i + 1);
+        if (!quiet)
+            printf("Cleared %d %02d %s.\n", YEAR(year), day, lang->name);
+    }
+    if (*word != old)
+        undo_push((delta) { U_WORD, 0, lang - langs, 0, year, *word ^ old, { NULL, NULL } });
+}
+
+
+/* packs the even bits of w (i.e the first bit of each day) into 25 bits */
+uint32_t compact(uint64_t w) {
+    w &= DAY_BITS;
+    w = (w | (w >> 1))  & UINT64_C(0x3333333333333333);
+    w = (w | (w >> 2))  & UINT64_C(0x0F0F0F0F0F0F0F0F);
+    w = (w | (w >> 4))  & UINT64_C(0x00FF00FF00FF00FF);
+    w = (w | (w >> 8))  & UINT64_C(0x0000FFFF0000FFFF);
+    w = (w | (w >> 16)) & UINT64_C(0x00000000FFFFFFFF);
+    return w;
+}
+
+
+/* inverse of compact, moves the 25 first bits of d to the even bits */
+uint64_t spread(uint32_t d) {
+    uint64_t w = d & ALL_DAYS;
+    w = (w | (w << 16)) & UINT64_C(0x0000FFFF0000FFFF);
+    w = (w | (w << 8))  & UINT64_C(0x00FF00FF00FF00FF);
+    w = (w | (w << 4))  & UINT64_C(0x0F0F0F0F0F0F0F0F);
+    w = (w | (w << 2))  & UINT64_C(0x3333333333333333);
+    w = (w | (w << 1))  & UINT64_C(0x5555555555555555);
+    return w;
+}
+
+
+/* the days of a year word that are in the given state, one bit per day */
+uint32_t plane(uint64_t w, state s) {
+    uint32_t c = compact(w);
+    if (s == COMPLETED)
+        return c;
+    uint32_t st = compact(w >> 1) & ~c;
+    return s == STARTED ? st : ~(c | st) & ALL_DAYS;
+}
+
+
+int new_year() {
+    if (max_year == UINT8_MAX) {
+        printf(
+            "Error adding new year: maximum year is %u (%u).\n",
+            UINT8_MAX, YEAR(UINT8_MAX)
+        );
+        return 0;
+    }
+
+    for (int i = 0; i < langs_sz; ++i) {
+        uint64_t *ptr = realloc(langs[i].bits, (max_year + 1) * sizeof(uint64_t));
+        if (!ptr) {
+            puts("Error adding new year: OOM.");
+            return 0;
+        }
+        langs[i].bits = ptr;
+        langs[i].bits[max_year] = 0;
+    }
+
+    printf("Added year %u (%u).\n", max_year, YEAR(max_year));
+    max_year++;
+    undo_push((delta) { U_YEAR_ADD, 0, 0, 0, max_year - 1, 0, { NULL, NULL } });
+
+    return 1;
+}
+
+
+int del_year() {
+    if (!max_year) {
+        puts("Error removing year: cannot remove year 0 (2015).");
+        return 0;
+    }
+    max_year--;
+    for (int i = 0; i < langs_sz; ++i) {
+        uint64_t w = langs[i].bits[max_year];
+        if (w)
+            undo_push((delta) { U_WORD, 0, i, 0, max_year, w, { NULL, NULL } });
+        langs[i].bits[max_year] = 0;
+    }
+    undo_push((delta) { U_YEAR_RM, 0, 0, 0, max_year, 0, { NULL, NULL } });
+    printf("Removed year %u (%u).\n", max_year, YEAR(max_year));
+
+    return 1;
+}
+
+
+lang *add_lang(const char *name) {
+    if (langs_sz == INT32_MAX) {
+        printf("Error adding lang: maximum %d languages allowed\n.", INT32_MAX);
+        return 0;
+    }
+
+    if (strlen(name) > UINT8_MAX) {
+        printf(
+            "Error adding lang: '%s' length is too long (maximum %d).\n",
+            name, UINT8_MAX
+        );
+        return NULL;
+    }
+
+    int n = index_of(name);
+    if (n >= 0) {
+        printf("Error adding lang: %s already exists.\n", langs[n].name);
+        return NULL;
+    }
+
+    if (!resize_langs(langs_sz + 1))
+        return 0;
+
+    n = estimate_index_of(name);
+
+    /* name is stack allocated */
+    char *z = malloc(strlen(name) + 1);
+    if (!z) {
+        puts("Allocation error: OOM.");
+        return 0;
+    }
+    strcpy(z, name);
+
+    lang l = { z, langs[langs_sz].bits };
+    if (n != langs_sz)
+        memmove(&langs[n + 1], &langs[n], (langs_sz - n) * sizeof(lang));
+    langs[n] = l;
+    langs_sz++;
+    undo_push((delta) { U_ADD, 0, n, 0, 0, 0, { NULL, NULL } });
+
+    return &langs[n];
+}
+
+
+int rename_lang(const char *oldn, const char *newn) {
+    if (!strcmp(oldn, newn)) {
+        printf(
+            "Error renaming lang: newn name is identical to the oldn one ('%s')\n",
+            oldn
+        );
+        return 0;
+    }
+
+    int oldi = index_of(oldn);
+    if (oldi < 0) {
+        printf("Error renaming lang: '%s' does not exist.\n", oldn);
+        return 0;
+    }
+
+    int newi = oldi;
+    if (strcasecmp(oldn, newn)) {
+        newi = estimate_index_of(newn);
+        if (newi < 0) {
+            newi = index_of(newn);
+            printf("Error renaming lang: '%s' already exists.\n", langs[newi].name);
+            return 0;
+        }
+        if (newi > oldi)
+            newi--;
+    }
+
+    char *z = malloc(strlen(newn) + 1);
+    if (!z) {
+        puts("Allocation error: OOM.");
+        return 0;
+    }
+    strcpy(z, newn);
+
+    move_lang(oldi, newi);
+    printf("Renamed lang '%s' to '%s'.\n", langs[newi].name, newn);
+    undo_push((delta) { U_RENAME, 0, oldi, newi, 0, 0, { langs[newi].name, NULL } });
+    langs[newi].name = z;
+    langs[newi].hist_id = 0;
+
+    return 1;
+}
+
+
+int remove_lang(const char *name) {
+    int i = index_of(name);
+    if (i < 0) {
+        printf("Error removing lang: '%s' does not exist.\n", name);
+        return 0;
+    }
+
+    delta d = { U_REMOVE, 0, i, 0, 0, 0, { NULL, NULL } };
+    take_lang(&d);
+    printf("Removed lang '%s'.\n", name);
+    undo_push(d);
+
+    return 1;
+}
+
+
+/* kernels */
+
+/*
+ * Scans over arrays of year words. The matches of a word are stored like its
+ * completed days, on the even bits. The vectorized versions are picked at
+ * startup from the features of the cpu, and must give the same results as the
+ * scalar ones ('AOC_KERNEL=scalar' forces them, to compare both).
+ */
+typedef struct {
+    const char *name;
+    /* m[i] (if m is not NULL) = the matches of w[i], returns their count */
+    size_t (*match)(const uint64_t *w, size_t n, const uint64_t *sel, uint64_t *m);
+    /* index of the word holding the match of rank *r, *r becomes its rank there */
+    size_t (*locate)(const uint64_t *m, size_t n, size_t *r);
+} kernels;
+
+
+/* the days to match in each state (as not_yet, started, completed) */
+void select_days(uint64_t sel[3], uint8_t ts, uint32_t td) {
+    uint64_t d = spread(td);
+    for (int s = 0; s < 3; ++s)
+        sel[s] = IS_SET(ts, s) ? d : 0;
+}
+
+
+static inline uint64_t match_word(uint64_t w, const uint64_t *sel) {
+    uint64_t s = w >> 1;
+    return (~(w | s) & sel[0]) | (s & ~w & sel[1]) | (w & sel[2]);
+}
+
+
+size_t match_scalar(const uint64_t *w, size_t n, const uint64_t *sel, uint64_t *m) {
+    size_t c = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t x = match_word(w[i], sel);
+        if (m)
+            m[i] = x;
+        c += popcount(x);
+    }
+    return c;
+}
+
+
+size_t locate_scalar(const uint64_t *m, size_t n, size_t *r) {
+    for (size_t i = 0; i < n; ++i) {
+        size_t c = popcount(m[i]);
+        if (*r < c)
+            return i;
+        *r -= c;
+    }
+    return n;
+}
+
+
+#ifdef X86_KERNELS
+
+/*
+ * Matches are on even bits only, so the popcount starts from the sums of the
+ * pairs of bits, and psadbw adds up the bytes of each word.
+ */
+TARGET("sse2")
+static inline __m128i pop_even_sse2(__m128i x) {
+    const __m128i m2 = _mm_set1_epi8(0x33), m4 = _mm_set1_epi8(0x0F);
+    x = _mm_add_epi64(_mm_and_si128(x, m2), _mm_and_si128(_mm_srli_epi64(x, 2), m2));
+    x = _mm_and_si128(_mm_add_epi64(x, _mm_srli_epi64(x, 4)), m4);
+    return _mm_sad_epu8(x, _mm_setzero_si128());
+}
+
+
+TARGET("sse2")
+static inline __m128i match_sse2_vec(__m128i w, __m128i s0, __m128i s1, __m128i s2) {
+    __m128i s = _mm_srli_epi64(w, 1);
+    return _mm_or_si128(
+        _mm_or_si128(_mm_andnot_si128(_mm_or_si128(w, s), s0), _mm_and_si128(_mm_andnot_si128(w, s), s1)),
+        _mm_and_si128(w, s2)
+    );
+}
+
+
+TARGET("sse2")
+static inline size_t sum_sse2(__m128i x) {
+    uint64_t t[2];
+    _mm_storeu_si128((__m128i *) t, x);
+    return t[0] + t[1];
+}
+
+
+TARGET("sse2")
+size_t match_sse2(const uint64_t *w, size_t n, const uint64_t *sel, uint64_t *m) {
+    __m128i s0 = _mm_set1_epi64x(sel[0]), s1 = _mm_set1_epi64x(sel[1]);
+    __m128i s2 = _mm_set1_epi64x(sel[2]), c = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i x = match_sse2_vec(_mm_loadu_si128((const __m128i *) &w[i]), s0, s1, s2);
+        if (m)
+            _mm_storeu_si128((__m128i *) &m[i], x);
+        c = _mm_add_epi64(c, pop_even_sse2(x));
+    }
+    return sum_sse2(c) + match_scalar(&w[i], n - i, sel, m ? &m[i] : NULL);
+}
+
+
+/* skips blocks of matches while the rank is past them */
+TARGET("sse2")
+size_t locate_sse2(const uint64_t *m, size_t n, size_t *r) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i *v = (const __m128i *) &m[i];
+        __m128i c = _mm_add_epi64(pop_even_sse2(_mm_loadu_si128(&v[0])), pop_even_sse2(_mm_loadu_si128(&v[1])));
+        c = _mm_add_epi64(c, pop_even_sse2(_mm_loadu_si128(&v[2])));
+        c = _mm_add_epi64(c, pop_even_sse2(_mm_loadu_si128(&v[3])));
+        size_t s = sum_sse2(c);
+        if (*r < s)
+            break;
+        *r -= s;
+    }
+    return i + locate_scalar(&m[i], n - i, r);
+}
+
+
+TARGET("avx2")
+static inline __m256i pop_even_avx2(__m256i x) {
+    const __m256i m2 = _mm256_set1_epi8(0x33), m4 = _mm256_set1_epi8(0x0F);
+    x = _mm256_add_epi64(_mm256_and_si256(x, m2), _mm256_and_si256(_mm256_srli_epi64(x, 2), m2));
+    x = _mm256_and_si256(_mm256_add_epi64(x, _mm256_srli_epi64(x, 4)), m4);
+    return _mm256_sad_epu8(x, _mm256_setzero_si256());
+}
+
+
+TARGET("avx2")
+static inline __m256i match_avx2_vec(__m256i w, __m256i s0, __m256i s1, __m256i s2) {
+    __m256i s = _mm256_srli_epi64(w, 1);
+    return _mm256_or_si256(
+        _mm256_or_si256(_mm256_andnot_si256(_mm256_or_si256(w, s), s0), _mm256_and_si256(_mm256_andnot_si256(w, s), s1)),
+        _mm256_and_si256(w, s2)
+    );
+}
+
+
+TARGET("avx2")
+static inline size_t sum_avx2(__m256i x) {
+    uint64_t t[4];
+    _mm256_storeu_si256((__m256i *) t, x);
+    return t[0] + t[1] + t[2] + t[3];
+}
+
+
+TARGET("avx2")
+size_t match_avx2(const uint64_t *w, size_t n, const uint64_t *sel, uint64_t *m) {
+    __m256i s0 = _mm256_set1_epi64x(sel[0]), s1 = _mm256_set1_epi64x(sel[1]);
+    __m256i s2 = _mm256_set1_epi64x(sel[2]), c = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = match_avx2_vec(_mm256_loadu_si256((const __m256i *) &w[i]), s0, s1, s2);
+        if (m)
+            _mm256_storeu_si256((__m256i *) &m[i], x);
+        c = _mm256_add_epi64(c, pop_even_avx2(x));
+    }
+    return sum_avx2(c) + match_scalar(&w[i], n - i, sel, m ? &m[i] : NULL);
+}
+
+
+TARGET("avx2")
+size_t locate_avx2(const uint64_t *m, size_t n, size_t *r) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256i *v = (const __m256i *) &m[i];
+        __m256i c = _mm256_add_epi64(pop_even_avx2(_mm256_loadu_si256(&v[0])), pop_even_avx2(_mm256_loadu_si256(&v[1])));
+        c = _mm256_add_epi64(c, pop_even_avx2(_mm256_loadu_si256(&v[2])));
+        c = _mm256_add_epi64(c, pop_even_avx2(_mm256_loadu_si256(&v[3])));
+        size_t s = sum_avx2(c);
+        if (*r < s)
+            break;
+        *r -= s;
+    }
+    return i + locate_scalar(&m[i], n - i, r);
+}
+
+
+TARGET("avx512f,avx512bw")
+static inline __m512i pop_even_avx512(__m512i x) {
+    const __m512i m2 = _mm512_set1_epi8(0x33), m4 = _mm512_set1_epi8(0x0F);
+    x = _mm512_add_epi64(_mm512_and_si512(x, m2), _mm512_and_si512(_mm512_srli_epi64(x, 2), m2));
+    x = _mm512_and_si512(_mm512_add_epi64(x, _mm512_srli_epi64(x, 4)), m4);
+    return _mm512_sad_epu8(x, _mm512_setzero_si512());
+}
+
+
+TARGET("avx512f,avx512bw")
+static inline __m512i match_avx512_vec(__m512i w, __m512i s0, __m512i s1, __m512i s2) {
+    __m512i s = _mm512_srli_epi64(w, 1);
+    return _mm512_or_si512(
+        _mm512_or_si512(_mm512_andnot_si512(_mm512_or_si512(w, s), s0), _mm512_and_si512(_mm512_andnot_si512(w, s), s1)),
+        _mm512_and_si512(w, s2)
+    );
+}
+
+
+TARGET("avx512f,avx512bw")
+size_t match_avx512(const uint64_t *w, size_t n, const uint64_t *sel, uint64_t *m) {
+    __m512i s0 = _mm512_set1_epi64(sel[0]), s1 = _mm512_set1_epi64(sel[1]);
+    __m512i s2 = _mm512_set1_epi64(sel[2]), c = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512i x = match_avx512_vec(_mm512_loadu_si512(&w[i]), s0, s1, s2);
+        if (m)
+            _mm512_storeu_si512(&m[i], x);
+        c = _mm512_add_epi64(c, pop_even_avx512(x));
+    }
+    return _mm512_reduce_add_epi64(c) + match_scalar(&w[i], n - i, sel, m ? &m[i] : NULL);
+}
+
+
+TARGET("avx512f,avx512bw")
+size_t locate_avx512(const uint64_t *m, size_t n, size_t *r) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512i c = _mm512_add_epi64(pop_even_avx512(_mm512_loadu_si512(&m[i])), pop_even_avx512(_mm512_loadu_si512(&m[i + 8])));
+        c = _mm512_add_epi64(c, pop_even_avx512(_mm512_loadu_si512(&m[i + 16])));
+        c = _mm512_add_epi64(c, pop_even_avx512(_mm512_loadu_si512(&m[i + 24])));
+        size_t s = _mm512_reduce_add_epi64(c);
+        if (*r < s)
+            break;
+        *r -= s;
+    }
+    return i + locate_scalar(&m[i], n - i, r);
+}
+
+#endif
+
+
+const kernels kernel_levels[] = {
+    { "scalar", match_scalar, locate_scalar },
+#ifdef X86_KERNELS
+    { "sse2", match_sse2, locate_sse2 },
+    { "avx2", match_avx2, locate_avx2 },
+    { "avx512", match_avx512, locate_avx512 },
+#endif
+};
+kernels kern = { "scalar", match_scalar, locate_scalar };
+
+
+/* picks the best supported kernels, or lower ones if AOC_KERNEL names them */
+void select_kernels() {
+    int level = 0;
+#ifdef X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        level = 1;
+    if (level && __builtin_cpu_supports("avx2"))
+        level = 2;
+    if (level > 1 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        level = 3;
+#endif
+    const char *s = getenv("AOC_KERNEL");
+    for (int i = 0; s && i < level; ++i)
+        if (str_eq1(s, kernel_levels[i].name))
+            level = i;
+    kern = kernel_levels[level];
+}
+
+
+/* (de)serialization */
+
+int deserialize() {
+    if (edit_mode)
+        return 1;
+
+    FILE *fp = fopen(filename, "rb+");
+    if (!fp) {
+        printf("Error reading data: '%s' could not be opened.\n", filename);
+        return 0;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size_t sz = ftell(fp);
+    if (!sz)
+        goto invalid_file;
+    rewind(fp);
+
+    max_year = fgetc(fp);
+    if (max_year) {
+        size_t est_sz = sz / (max_year * 8);
+        if (est_sz && !resize_langs(est_sz)) {
+            fclose(fp);
+            return 0;
+        }
+    }
+
+    char name[UINT8_MAX];
+    memset(name, 0, sizeof(name));
+
+    while (sz - ftell(fp) > 0) {
+        uint8_t name_sz = fgetc(fp);
+        if (!name_sz || sz - ftell(fp) < name_sz + max_year * sizeof(int64_t))
+            goto invalid_file;
+
+        fread(name, 1, name_sz, fp);
+        name[name_sz] = '\0';
+
+        lang *l = add_lang(name);
+        if (!l)
+            goto invalid_file;
+
+        if (max_year)
+            fread(l->bits, sizeof(int64_t), max_year, fp);
+    }
+
+    fclose(fp);
+    return 1;
+
+    invalid_file:
+    printf("Error reading data: '%s' contains invalid data.\n", filename);
+    fclose(fp);
+    return 0;
+}
+
+
+int serialize() {
+    if (edit_mode)
+        return 1;
+
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        printf("Error saving data: '%s' could not be opened.\n", filename);
+        return 0;
+    }
+
+    fputc(max_year, fp);
+
+    for (int i = 0; i < langs_sz; ++i) {
+        uint8_t sz = strlen(langs[i].name);
+        if (!fputc(sz, fp)
+            || !fwrite(langs[i].name, 1, sz, fp)
+            || !fwrite(langs[i].bits, 1, max_year * sizeof(uint64_t), fp))
+            goto failure;
+    }
+
+    fclose(fp);
+    printf("Saved data to '%s'.\n", filename);
+    hist_flush();
+    return 1;
+
+    failure:
+    printf("Error saving data: could not write to '%s'.\n", filename);
+    fclose(fp);
+    return 0;
+}
+
+
+typedef struct {
+    FILE *fp;
+    uint8_t years;
+    char name[UINT8_MAX + 1];
+    uint64_t words[UINT8_MAX];
+} stream;
+
+
+/* opens a data file to read it one language at a time */
+int stream_open(stream *s, const char *path) {
+    s->fp = fopen(path, "rb");
+    if (!s->fp)
+        return 0;
+    int c = fgetc(s->fp);
+    if (c == EOF) {
+        fclose(s->fp);
+        s->fp = NULL;
+        return 0;
+    }
+    s->years = c;
+    s->name[0] = '\0';
+    return 1;
+}
+
+
+/* returns 1 if a language was read, 0 at the end of the file, -1 if invalid */
+int stream_next(stream *s) {
+    int n = fgetc(s->fp);
+    if (n == EOF)
+        return 0;
+    if (!n || fread(s->name, 1, n, s->fp) != (size_t) n
+        || fread(s->words, sizeof(uint64_t), s->years, s->fp) != s->years)
+        return -1;
+    s->name[n] = '\0';
+    return 1;
+}
+
+
+/*
+ * The index file used by completion holds the size and modification time of
+ * the data file, the time the index was built at, then the number of years and
+ * the language names. It is only trusted if the data file was last modified in
+ * an earlier second than the index was built, as a later change in the same
+ * second would keep the same modification time.
+ */
+typedef struct {
+    int64_t size, mtime, built;
+} index_stamp;
+
+
+int data_stamp(index_stamp *st) {
+    struct stat sb;
+    if (stat(filename, &sb))
+        return 0;
+    st->size = sb.st_size;
+    st->mtime = sb.st_mtime;
+    st->built = time(NULL);
+    return 1;
+}
+
+
+/* reads the next name, skipping the words that follow it in the data file */
+int next_name(FILE *fp, int words, char *name) {
+    int n = fgetc(fp);
+    if (n == EOF || !n || fread(name, 1, n, fp) != (size_t) n)
+        return 0;
+    name[n] = '\0';
+    return !words || !fseek(fp, words * (long) sizeof(uint64_t), SEEK_CUR);
+}
+
+
+/* rebuilds the index from the data file, the stamp being written last */
+int write_index(const index_stamp *st) {
+    char path[PATH_SZ + 8], name[UINT8_MAX + 1];
+    FILE *in = fopen(filename, "rb");
+    if (!in)
+        return 0;
+    snprintf(path, sizeof(path), "%s.idx", filename);
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        fclose(in);
+        return 0;
+    }
+
+    index_stamp none = { -1, -1, -1 };
+    int years = fgetc(in);
+    int ok = years != EOF && fwrite(&none, sizeof(none), 1, fp) && fputc(years, fp) != EOF;
+    while (ok && next_name(in, years, name)) {
+        uint8_t n = strlen(name);
+        ok = fputc(n, fp) != EOF && fwrite(name, 1, n, fp) == n;
+    }
+    ok = ok && feof(in);
+    fclose(in);
+    ok = ok && !fseek(fp, 0, SEEK_SET) && fwrite(st, sizeof(*st), 1, fp);
+    if (fclose(fp) || !ok) {
+        remove(path);
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * Opens the index file, rebuilding it if it is out of date and the data file
+ * was not modified during the current second, else falls back to the data
+ * file. The file is positioned at the first language name, years is set to
+ * the number of years and words to the number of words following each name.
+ */
+FILE *open_names(uint8_t *years, int *words) {
+    char path[PATH_SZ + 8];
+    index_stamp st, ist;
+    if (!data_stamp(&st))
+        return NULL;
+
+    snprintf(path, sizeof(path), "%s.idx", filename);
+    FILE *fp = fopen(path, "rb");
+    int fresh = fp && fread(&ist, sizeof(ist), 1, fp)
+        && ist.size == st.size && ist.mtime == st.mtime && ist.built > ist.mtime;
+    if (!fresh && fp) {
+        fclose(fp);
+        fp = NULL;
+    }
+    if (!fresh && st.built > st.mtime && write_index(&st))
+        fresh = (fp = fopen(path, "rb")) && !fseek(fp, sizeof(ist), SEEK_SET);
+    if (!fresh) {
+        if (fp)
+            fclose(fp);
+        if (!(fp = fopen(filename, "rb")))
+            return NULL;
+    }
+
+    int c = fgetc(fp);
+    if (c == EOF) {
+        fclose(fp);
+        return NULL;
+    }
+    *years = c;
+    *words = fresh ? 0 : c;
+    return fp;
+}
+
+
+/* profiles */
+
+int valid_profile(const char *s) {
+    if (!*s || *s == '.' || strlen(s) > UINT8_MAX)
+        return 0;
+    for (; *s; ++s)
+        if (!isalnum((unsigned char) *s) && !strchr("._-", *s))
+            return 0;
+    return 1;
+}
+
+
+void set_filename(const char *path) {
+    snprintf(filename, sizeof(filename), "%s", path);
+    snprintf(histname, sizeof(histname), "%s.hist", path);
+}
+
+
+/* data file of a profile, relative to the home directory: XX/user.aoc */
+void shard_path(char *z, size_t sz, const char *user) {
+    snprintf(z, sz, "%02x/%s%s", hash_name(user) & 0xFF, user, FILENAME);
+}
+
+
+/*
+ * Selects the data file of the given profile, or of the current user if only
+ * AOC_HOME is set. Returns 0 if the profile name is invalid.
+ */
+int select_profile(const char *user) {
+    const char *env = getenv("AOC_HOME");
+    if (!user && !env)
+        return 1;
+
+    if (!user && !(user = getenv("USER")) && !(user = getenv("USERNAME")))
+        user = "default";
+    if (!valid_profile(user)) {
+        printf(
+            "Incorrect profile name: '%s' (expected letters, digits, '.', '_' "
+            "or '-').\n", user
+        );
+        return 0;
+    }
+
+    char z[UINT8_MAX + 16], path[PATH_SZ];
+    if (env && strlen(env) >= sizeof(home)) {
+        puts("Incorrect AOC_HOME: path is too long.");
+        return 0;
+    }
+    snprintf(home, sizeof(home), "%s", env ? env : HOMEDIR);
+    /* profile names are case insensitive, like their hash */
+    for (size_t i = 0; user[i]; ++i)
+        profile[i] = tolower((unsigned char) user[i]);
+    profile[strlen(user)] = '\0';
+    shard_path(z, sizeof(z), profile);
+    snprintf(path, sizeof(path), "%s/%s", home, z);
+    set_filename(path);
+    return 1;
+}
+
+
+/* creates the shard directory of the profile and adds it to the manifest */
+int register_profile() {
+    char z[UINT8_MAX + 16], line[PATH_SZ];
+
+    mkdir(home, 0755);
+    shard_path(z, sizeof(z), profile);
+    snprintf(line, sizeof(line), "%s/%.2s", home, z);
+    mkdir(line, 0755);
+
+    snprintf(line, sizeof(line), "%s/%s", home, MANIFEST);
+    FILE *fp = fopen(line, "r");
+    if (fp) {
+        size_t n = strlen(profile);
+        while (fgets(line, sizeof(line), fp))
+            if (!strncmp(line, profile, n) && line[n] == '\t') {
+                fclose(fp);
+                return 1;
+            }
+        fclose(fp);
+    }
+
+    snprintf(line, sizeof(line), "%s/%s", home, MANIFEST);
+    fp = fopen(line, "a");
+    if (!fp || fprintf(fp, "%s\t%s\n", profile, z) < 0) {
+        printf("Error saving manifest: '%s' could not be written to.\n", line);
+        if (fp)
+            fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+    return 1;
+}
+
+
+/*
+ * Calls fn with the name and data file of each profile of the manifest, in
+ * order. Stops and returns 0 as soon as fn does.
+ */
+int for_each_profile(int (*fn)(const char *, const char *, void *), void *arg) {
+    char line[PATH_SZ / 2], path[PATH_SZ];
+
+    const char *env = getenv("AOC_HOME");
+    if (env && strlen(env) >= PATH_SZ / 2) {
+        puts("Incorrect AOC_HOME: path is too long.");
+        return 0;
+    }
+    snprintf(path, sizeof(path), "%s/%s", env ? env : HOMEDIR, MANIFEST);
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        printf("Error reading manifest: '%s' could not be opened.\n", path);
+        return 0;
+    }
+
+    int ok = 1;
+    while (ok && fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *tab = strchr(line, '\t');
+        if (!tab)
+            continue;
+        *tab = '\0';
+        snprintf(path, sizeof(path), "%.*s/%s", PATH_SZ / 2 - 1, env ? env : HOMEDIR, tab + 1);
+        ok = fn(line, path, arg);
+    }
+
+    fclose(fp);
+    return ok;
+}
+
+
+/* print */
+
+/* fl has one bit per language, or is NULL for every language */
+void print(const uint64_t *fl, uint64_t fy, uint32_t fd) {
+    int max_length = 4;
+
+    for (int i = 0; i < langs_sz; ++i) {
+        if (!LANG_SET(fl, i))
+            continue;
+        int n = strlen(langs[i].name);
+        max_length = (n > max_length) ? n : max_length;
+    }
+
+    int line_length = max_length + 2;
+    for (int i = 0; i < 25; ++i)
+        if (IS_SET(fd, i))
+            line_length += 3;
+
+    for (int z = 0; z < langs_sz; ++z) {
+        if (!LANG_SET(fl, z))
+            continue;
+
+        printf("%*s |", max_length, langs[z].name);
+        for (int day = 0; day < 25; ++day)
+            if (IS_SET(fd, day))
+                printf(" %2d", day + 1);
+        putchar('\n');
+        for (int i = 0; i < line_length; ++i)
+            putchar('_');
+        putchar('\n');
+
+        for (int year = 0; year < max_year; ++year) {
+            if (!IS_SET(fy, year))
+                continue;
+            /* both bits of a day index its state: none, completed, started */
+            char row[25 * 3 + 1], *c = row;
+            uint64_t w = WORD(&langs[z], year);
+            for (int day = 0; day < 25; ++day, w >>= 2)
+                if (IS_SET(fd, day)) {
+                    *c++ = ' ';
+                    *c++ = ' ';
+                    *c++ = ".CSC"[w & 3];
+                }
+            *c = '\0';
+            printf("%*d |%s\n", max_length, YEAR(year), row);
+        }
+        putchar('\n');
+    }
+}
+
+
+/* query */
+
+typedef enum {
+    Q_PRED,
+    Q_AND,
+    Q_OR,
+    Q_NOT,
+    Q_ALL,
+    Q_ANY
+} q_opcode;
+
+
+typedef struct {
+    q_opcode op;
+    state s;
+    int year;    /* -1 for any year */
+    int lang;    /* -1 for every language */
+} q_op;
+
+
+typedef struct {
+    const char *src, *pos, *start;
+    int type;    /* 0 at the end, '(', ')', ',', 'w' for words */
+    char tok[UINT8_MAX + 2];
+    q_op plan[QUERY_MAX_OPS];
+    int sz;
+} query;
+
+
+int q_error(query *q, const char *msg) {
+    printf("Error in query: %s at position %d.\n", msg, (int) (q->start - q->src) + 1);
+    return 0;
+}
+
+
+int q_next(query *q) {
+    while (*q->pos == ' ' || *q->pos == '\t')
+        q->pos++;
+    q->start = q->pos;
+
+    char c = *q->pos;
+    if (!c || c == '(' || c == ')' || c == ',') {
+        q->type = c;
+        q->pos += !!c;
+        return 1;
+    }
+
+    size_t n = 0;
+    q->type = 'w';
+    if (c == '"' || c == '\'') {
+        for (q->pos++; *q->pos && *q->pos != c; q->pos++)
+            if (n <= UINT8_MAX)
+                q->tok[n++] = *q->pos;
+        if (!*q->pos)
+            return q_error(q, "unterminated string");
+        q->pos++;
+    } else
+        for (; *q->pos && !strchr(" \t(),", *q->pos); q->pos++)
+            if (n <= UINT8_MAX)
+                q->tok[n++] = *q->pos;
+    q->tok[n] = '\0';
+    return 1;
+}
+
+
+int q_emit(query *q, q_opcode op, state s, int year, int lang) {
+    if (q->sz == QUERY_MAX_OPS)
+        return q_error(q, "query is too long");
+    q->plan[q->sz++] = (q_op) { op, s, year, lang };
+    return 1;
+}
+
+
+static inline int q_expect(query *q, int type, const char *msg) {
+    if (q->type != type)
+        return q_error(q, msg);
+    return q_next(q);
+}
+
+
+int q_expr(query *q);
+
+
+int q_factor(query *q) {
+    if (q->type == '(')
+        return q_next(q) && q_expr(q) && q_expect(q, ')', "expected ')'");
+
+    if (q->type != 'w')
+        return q_error(q, "expected a predicate");
+
+    if (str_eq1(q->tok, "not"))
+        return q_next(q) && q_factor(q) && q_emit(q, Q_NOT, NOT_YET, 0, 0);
+
+    if (str_eq2(q->tok, "all", "any")) {
+        q_opcode op = str_eq1(q->tok, "all") ? Q_ALL : Q_ANY;
+        return q_next(q) && q_expect(q, '(', "expected '('") && q_expr(q)
+            && q_expect(q, ')', "expected ')'") && q_emit(q, op, NOT_YET, 0, 0);
+    }
+
+    state s;
+    if (str_eq1(q->tok, "completed"))
+        s = COMPLETED;
+    else if (str_eq1(q->tok, "started"))
+        s = STARTED;
+    else if (str_eq1(q->tok, "not_yet"))
+        s = NOT_YET;
+    else
+        return q_error(q, "unknown predicate");
+
+    if (!q_next(q) || !q_expect(q, '(', "expected '('"))
+        return 0;
+
+    int y = -1;
+    if (q->type != 'w')
+        return q_error(q, "expected a year");
+    if (strcmp(q->tok, "*")) {
+        char *end;
+        y = strtol(q->tok, &end, 10);
+        if (y > 2000)
+            y -= 2000;
+        y -= 15;
+        if (*end || y < 0 || y >= max_year)
+            return q_error(q, "incorrect year");
+    }
+    if (!q_next(q))
+        return 0;
+
+    int l = -1;
+    if (q->type == ',') {
+        if (!q_next(q))
+            return 0;
+        if (q->type != 'w')
+            return q_error(q, "expected a language");
+        if ((l = index_of(q->tok)) < 0)
+            return q_error(q, "unknown language");
+        if (!q_next(q))
+            return 0;
+    }
+
+    return q_expect(q, ')', "expected ')'") && q_emit(q, Q_PRED, s, y, l);
+}
+
+
+int q_term(query *q) {
+    if (!q_factor(q))
+        return 0;
+    while (q->type == 'w' && str_eq1(q->tok, "and"))
+        if (!q_next(q) || !q_factor(q) || !q_emit(q, Q_AND, NOT_YET, 0, 0))
+            return 0;
+    return 1;
+}
+
+
+int q_expr(query *q) {
+    if (!q_term(q))
+        return 0;
+    while (q->type == 'w' && str_eq1(q->tok, "or"))
+        if (!q_next(q) || !q_term(q) || !q_emit(q, Q_OR, NOT_YET, 0, 0))
+            return 0;
+    return 1;
+}
+
+
+/* compiles src into a postfix plan of bitmask operations */
+int q_compile(query *q, const char *src) {
+    q->src = q->pos = src;
+    q->sz = 0;
+    return q_next(q) && q_expr(q) && q_expect(q, 0, "expected the end of the query");
+}
+
+
+/* evaluates the plan for one language, returns the matching days */
+uint32_t q_eval(const query *q, int l) {
+    uint32_t stack[QUERY_MAX_OPS];
+    int sp = 0;
+
+    for (int i = 0; i < q->sz; ++i) {
+        const q_op *op = &q->plan[i];
+        switch (op->op) {
+            case Q_PRED: {
+                /* a predicate naming a language gives its days for every row */
+                const lang *p = &langs[op->lang < 0 ? l : op->lang];
+                uint32_t m = 0;
+                if (op->year >= 0)
+                    m = plane(WORD(p, op->year), op->s);
+                else
+                    for (int y = 0; y < max_year; ++y)
+                        m |= plane(WORD(p, y), op->s);
+                stack[sp++] = m;
+                break;
+            }
+            case Q_AND: sp--; stack[sp - 1] &= stack[sp]; break;
+            case Q_OR:  sp--; stack[sp - 1] |= stack[sp]; break;
+            case Q_NOT: stack[sp - 1] = ~stack[sp - 1] & ALL_DAYS; break;
+            case Q_ALL: stack[sp - 1] = stack[sp - 1] == ALL_DAYS ? ALL_DAYS : 0; break;
+            case Q_ANY: stack[sp - 1] = stack[sp - 1] ? ALL_DAYS : 0; break;
+        }
+    }
+
+    return stack[0];
+}
+
+
+/* random */
+
+typedef struct {
+    uint32_t lang;
+    uint8_t year, day;
+} pick;
+
+
+/* year words of the filtered languages and years, gathered to be scanned */
+typedef struct {
+    const uint64_t *fl;
+    uint64_t fy;
+    uint32_t lang;
+    uint8_t year;
+    size_t n;
+    uint64_t w[SCAN_SZ];
+    uint64_t m[SCAN_SZ];
+    pick at[SCAN_SZ];
+} scan;
+
+
+void scan_start(scan *s, const uint64_t *fl, uint64_t fy) {
+    s->fl = fl;
+    s->fy = fy;
+    s->lang = 0;
+    s->year = 0;
+}
+
+
+/* gathers the next words into s->w, returns their count (0 at the end) */
+size_t scan_next(scan *s) {
+    s->n = 0;
+    for (; s->lang < langs_sz; ++s->lang, s->year = 0) {
+        if (!LANG_SET(s->fl, s->lang))
+            continue;
+        const uint64_t *bits = langs[s->lang].bits;
+        for (; s->year < max_year; ++s->year) {
+            if (!IS_SET(s->fy, s->year))
+                continue;
+            if (s->n == SCAN_SZ)
+                return s->n;
+            s->at[s->n] = (pick) { s->lang, s->year, 0 };
+            s->w[s->n++] = bits[s->year];
+        }
+    }
+    return s->n;
+}
+
+
+/* day of the match of rank r in m */
+static inline int nth_day(uint64_t m, size_t r) {
+    for (; r; --r)
+        m &= m - 1;
+    return popcount((m & -m) - 1) >> 1;
+}
+
+
+typedef enum {
+    W_EARLY = 1,
+    W_YEARS = 2,
+    W_LANGS = 4,
+    W_FRESH = 8
+} weight;
+
+
+/*
+ * Builds a Vose alias table over the n weights, so that drawing index i has a
+ * probability of w[i] / sum(w). Returns 0 if no weight is positive.
+ */
+int alias_build(const double *w, size_t n, double *prob, size_t *alias) {
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i)
+        sum += w[i];
+    if (sum <= 0)
+        return 0;
+
+    size_t *small = malloc(n * sizeof(size_t)), *large = malloc(n * sizeof(size_t));
+    if (!small || !large) {
+        puts("Allocation error: OOM.");
+        free(small);
+        free(large);
+        return 0;
+    }
+
+    size_t ns = 0, nl = 0;
+    for (size_t i = 0; i < n; ++i) {
+        prob[i] = w[i] * n / sum;
+        alias[i] = i;
+        if (prob[i] < 1)
+            small[ns++] = i;
+        else
+            large[nl++] = i;
+    }
+
+    while (ns && nl) {
+        size_t s = small[--ns], l = large[nl - 1];
+        alias[s] = l;
+        prob[l] -= 1 - prob[s];
+        if (prob[l] < 1) {
+            nl--;
+            small[ns++] = l;
+        }
+    }
+    /* leftovers are only off by rounding errors */
+    while (nl)
+        prob[large[--nl]] = 1;
+    while (ns)
+        prob[small[--ns]] = 1;
+
+    free(small);
+    free(large);
+    return 1;
+}
+
+
+static inline size_t alias_draw(const double *prob, const size_t *alias, size_t n) {
+    size_t i = random(n);
+    return (double) rand() / ((double) RAND_MAX + 1) < prob[i] ? i : alias[i];
+}
+
+
+int cmp_keys64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+
+/* loads the recent suggestions as sorted pick keys, returns their count */
+size_t load_recent(uint64_t *keys) {
+    char path[PATH_SZ + 8], line[UINT8_MAX + 16], name[UINT8_MAX + 1];
+    snprintf(path, sizeof(path), "%s.recent", filename);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return 0;
+
+    size_t n = 0;
+    int y, d;
+    while (n < RECENT_SZ && fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        int off = 0;
+        if (sscanf(line, "%d %d %n", &y, &d, &off) != 2 || !off)
+            continue;
+        snprintf(name, sizeof(name), "%s", &line[off]);
+        int l = index_of(name);
+        if (l < 0 || y < YEAR(0) || y >= YEAR(max_year) || d < 1 || d > 25)
+            continue;
+        keys[n++] = PICK_KEY(((pick) { l, y - YEAR(0), d - 1 }));
+    }
+    fclose(fp);
+
+    qsort(keys, n, sizeof(uint64_t), cmp_keys64);
+    return n;
+}
+
+
+/*
+ * Appends the picks to the recent suggestions, keeping the last RECENT_SZ.
+ * The file is only created once 'fresh' is used.
+ */
+void save_recent(const pick *picks, size_t k, int create) {
+    static char lines[RECENT_SZ][UINT8_MAX + 16];
+    char path[PATH_SZ + 8];
+    size_t n = 0;
+
+    snprintf(path, sizeof(path), "%s.recent", filename);
+    FILE *fp = fopen(path, "r");
+    if (fp) {
+        while (fgets(lines[n % RECENT_SZ], sizeof(lines[0]), fp))
+            if (strchr(lines[n % RECENT_SZ], '\n'))
+                n++;
+        fclose(fp);
+    } else if (!create)
+        return;
+    for (size_t i = 0; i < k; ++i, ++n)
+        snprintf(
+            lines[n % RECENT_SZ], sizeof(lines[0]), "%d %02d %s\n",
+            YEAR(picks[i].year), picks[i].day + 1, langs[picks[i].lang].name
+        );
+
+    fp = fopen(path, "w");
+    if (!fp)
+        return;
+    for (size_t i = n > RECENT_SZ ? n - RECENT_SZ : 0; i < n; ++i)
+        fputs(lines[i % RECENT_SZ], fp);
+    fclose(fp);
+}
+
+
+/* import / export */
+
+typedef struct {
+    FILE *fp;
+    size_t pos, len;
+    unsigned line;
+    char buf[IO_BUF_SZ];
+} reader;
+
+
+typedef struct {
+    char name[UINT8_MAX + 1];
+    int year, day;
+    state s;
+} record;
+
+
+typedef enum {
+    TK_ERROR,
+    TK_EOF,
+    TK_PUNCT,
+    TK_STRING,
+    TK_NUMBER,
+    TK_LITERAL
+} token;
+
+
+char out_buf[IO_BUF_SZ];
+size_t out_len = 0;
+
+record batch[BATCH_SZ];
+size_t batch_sz = 0;
+
+
+void out_flush() {
+    fwrite(out_buf, 1, out_len, stdout);
+    out_len = 0;
+}
+
+
+static inline void out_putc(char c) {
+    if (out_len == IO_BUF_SZ)
+        out_flush();
+    out_buf[out_len++] = c;
+}
+
+
+void out_puts(const char *s) {
+    for (; *s; ++s)
+        out_putc(*s);
+}
+
+
+void out_uint(unsigned n) {
+    char z[10];
+    int i = 0;
+    do {
+        z[i++] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    while (i)
+        out_putc(z[--i]);
+}
+
+
+void out_csv_str(const char *s) {
+    if (!strpbrk(s, ",\"\r\n")) {
+        out_puts(s);
+        return;
+    }
+    out_putc('"');
+    for (; *s; ++s) {
+        if (*s == '"')
+            out_putc('"');
+        out_putc(*s);
+    }
+    out_putc('"');
+}
+
+
+void out_json_str(const char *s) {
+    static const char *hex = "0123456789abcdef";
+    out_putc('"');
+    for (; *s; ++s) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            out_putc('\\');
+            out_putc(c);
+        } else if (c < 0x20) {
+            out_puts("\\u00");
+            out_putc(hex[c >> 4]);
+            out_putc(hex[c & 0xF]);
+        } else
+            out_putc(c);
+    }
+    out_putc('"');
+}
+
+
+int rd_getc(reader *r) {
+    if (r->pos == r->len) {
+        r->len = fread(r->buf, 1, IO_BUF_SZ, r->fp);
+        r->pos = 0;
+        if (!r->len)
+            return EOF;
+    }
+    char c = r->buf[r->pos++];
+    if (c == '\n')
+        r->line++;
+    return (unsigned char) c;
+}
+
+
+/* only valid right after a successful rd_getc */
+static inline void rd_ungetc(reader *r) {
+    if (r->buf[--r->pos] == '\n')
+        r->line--;
+}
+
+
+int import_error(unsigned line, const char *msg) {
+    printf("Error importing data: line %u: %s.\n", line, msg);
+    return 0;
+}
+
+
+/*
+ * Reads a csv field into z, which must be able to hold sz characters. Returns
+ * the character that ended the field (',', '\n' or EOF), or 0 if the field is
+ * invalid or too long.
+ */
+int csv_field(reader *r, char *z, size_t sz) {
+    size_t n = 0;
+    int c = rd_getc(r);
+
+    if (c == '"') {
+        for (;;) {
+            c = rd_getc(r);
+            if (c == EOF)
+                return 0;
+            if (c == '"' && (c = rd_getc(r)) != '"')
+                break;
+            if (n + 1 == sz)
+                return 0;
+            z[n++] = c;
+        }
+        if (c == '\r')
+            c = rd_getc(r);
+        z[n] = '\0';
+        return c == ',' || c == '\n' || c == EOF ? c : 0;
+    }
+
+    for (; c != ',' && c != '\n' && c != EOF; c = rd_getc(r)) {
+        if (c == '\r')
+            continue;
+        if (n + 1 == sz)
             return 0;
-        }
-        langs[i].bits = ptr;
-        langs[i].bits[max_year] = 0;
+        z[n++] = c;
     }
+    z[n] = '\0';
+    return c;
+}
 
-    printf("Added year %u (%u).\n", max_year, YEAR(max_year));
-    max_year++;
 
-    return 1;
+static inline size_t utf8_put(char *z, size_t n, size_t sz, unsigned u) {
+    char b[3];
+    int k = 0;
+    if (u < 0x80)
+        b[k++] = u;
+    else if (u < 0x800) {
+        b[k++] = 0xC0 | u >> 6;
+        b[k++] = 0x80 | (u & 0x3F);
+    } else {
+        b[k++] = 0xE0 | u >> 12;
+        b[k++] = 0x80 | ((u >> 6) & 0x3F);
+        b[k++] = 0x80 | (u & 0x3F);
+    }
+    for (int i = 0; i < k && n + 1 < sz; ++i)
+        z[n++] = b[i];
+    return n;
 }
 
 
-int del_year() {
-    if (!max_year) {
-        puts("Error removing year: cannot remove year 0 (2015).");
-        return 0;
-    }
-    max_year--;
-    for (int i = 0; i < langs_sz; ++i)
-        langs[i].bits[max_year] = 0;
-    printf("Removed year %u (%u).\n", max_year, YEAR(max_year));
+/*
+ * Reads the next json token. Strings, numbers and literals are copied to z
+ * (truncated to sz - 1 characters), punctuation is stored as a single
+ * character string.
+ */
+token json_next(reader *r, char *z, size_t sz) {
+    size_t n = 0;
+    int c;
 
-    return 1;
-}
+    do
+        c = rd_getc(r);
+    while (c == ' ' || c == '\t' || c == '\n' || c == '\r');
 
+    if (c == EOF)
+        return TK_EOF;
 
-lang *add_lang(const char *name) {
-    if (langs_sz == INT32_MAX) {
-        printf("Error adding lang: maximum %d languages allowed\n.", INT32_MAX);
-        return 0;
+    if (c && strchr("{}[]:,", c)) {
+        z[0] = c;
+        z[1] = '\0';
+        return TK_PUNCT;
     }
 
-    if (strlen(name) > UINT8_MAX) {
-        printf(
-            "Error adding lang: '%s' length is too long (maximum %d).\n",
-            name, UINT8_MAX
-        );
-        return NULL;
+    if (c == '"') {
+        while ((c = rd_getc(r)) != '"') {
+            if (c == EOF)
+                return TK_ERROR;
+            if (c == '\\') {
+                switch (c = rd_getc(r)) {
+                    case '"': case '\\': case '/': break;
+                    case 'b': c = '\b'; break;
+                    case 'f': c = '\f'; break;
+                    case 'n': c = '\n'; break;
+                    case 'r': c = '\r'; break;
+                    case 't': c = '\t'; break;
+                    case 'u': {
+                        unsigned u = 0;
+                        for (int i = 0; i < 4; ++i) {
+                            c = rd_getc(r);
+                            if (c == EOF || !isxdigit(c))
+                                return TK_ERROR;
+                            u = u * 16 + (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+                        }
+                        n = utf8_put(z, n, sz, u);
+                        continue;
+                    }
+                    default:
+                        return TK_ERROR;
+                }
+            }
+            if (n + 1 < sz)
+                z[n++] = c;
+        }
+        z[n] = '\0';
+        return TK_STRING;
     }
 
-    int n = index_of(name);
-    if (n >= 0) {
-        printf("Error adding lang: %s already exists.\n", langs[n].name);
-        return NULL;
+    if (c == '-' || isalnum(c)) {
+        token t = isalpha(c) ? TK_LITERAL : TK_NUMBER;
+        for (; c == '-' || c == '+' || c == '.' || isalnum(c); c = rd_getc(r))
+            if (n + 1 < sz)
+                z[n++] = c;
+        if (c != EOF)
+            rd_ungetc(r);
+        z[n] = '\0';
+        return t;
     }
 
-    if (!resize_langs(langs_sz + 1))
-        return 0;
+    return TK_ERROR;
+}
 
-    n = estimate_index_of(name);
 
-    /* name is stack allocated */
-    char *z = malloc(strlen(name) + 1);
-    if (!z) {
-        puts("Allocation error: OOM.");
+/*
+ * Reads the next key of an object and the ':' after it. Returns 1 if a key was
+ * read, 0 at the end of the object and -1 on invalid data.
+ */
+int json_key(reader *r, char *z, size_t sz) {
+    char c[2];
+    token t = json_next(r, z, sz);
+    if (t == TK_PUNCT && z[0] == ',')
+        t = json_next(r, z, sz);
+    if (t == TK_PUNCT && z[0] == '}')
         return 0;
-    }
-    strcpy(z, name);
+    if (t != TK_STRING || json_next(r, c, sizeof(c)) != TK_PUNCT || c[0] != ':')
+        return -1;
+    return 1;
+}
 
-    lang l = { z, langs[langs_sz].bits };
-    if (n != langs_sz)
-        memmove(&langs[n + 1], &langs[n], (langs_sz - n) * sizeof(lang));
-    langs[n] = l;
-    langs_sz++;
 
-    return &langs[n];
+static inline int json_open(reader *r) {
+    char c[2];
+    return json_next(r, c, sizeof(c)) == TK_PUNCT && c[0] == '{';
 }
 
 
-int rename_lang(const char *oldn, const char *newn) {
-    if (!strcmp(oldn, newn)) {
-        printf(
-            "Error renaming lang: newn name is identical to the oldn one ('%s')\n",
-            oldn
-        );
-        return 0;
-    }
-
-    int oldi = index_of(oldn);
-    if (oldi < 0) {
-        printf("Error renaming lang: '%s' does not exist.\n", oldn);
+/* skips the value starting with the token t (stored in z) */
+int json_skip(reader *r, token t, const char *z) {
+    if (t != TK_PUNCT)
+        return t == TK_STRING || t == TK_NUMBER || t == TK_LITERAL;
+    if (z[0] != '{' && z[0] != '[')
         return 0;
-    }
 
-    if (!strcasecmp(oldn, newn)) {
-        char *z = malloc(strlen(newn) + 1);
-        if (!z) {
-            puts("Allocation error: OOM.");
+    char c[2];
+    for (int depth = 1; depth;) {
+        t = json_next(r, c, sizeof(c));
+        if (t == TK_ERROR || t == TK_EOF)
             return 0;
-        }
-        strcpy(z, newn);
-        printf("Renamed lang '%s' to '%s'.\n", langs[oldi].name, newn);
-        free(langs[oldi].name);
-        langs[oldi].name = z;
-        return 1;
+        if (t == TK_PUNCT && (c[0] == '{' || c[0] == '['))
+            depth++;
+        else if (t == TK_PUNCT && (c[0] == '}' || c[0] == ']'))
+            depth--;
     }
+    return 1;
+}
 
-    int newi = estimate_index_of(newn);
-    if (newi < 0) {
-        newi = index_of(newn);
-        printf("Error renaming lang: '%s' already exists.\n", langs[newi].name);
-        return 0;
-    }
 
-    if (newi > oldi)
-        newi--;
+int apply_batch(lang **last) {
+    for (size_t i = 0; i < batch_sz; ++i) {
+        record *rec = &batch[i];
 
-    if (oldi != newi) {
-        lang l = langs[oldi];
-        memmove(&langs[oldi], &langs[newi], abs(oldi - newi) * sizeof(lang));
-        langs[newi] = l;
-    }
+        if (!*last || strcasecmp((*last)->name, rec->name)) {
+            /* add_lang moves other languages around, only keep this one */
+            *last = for_name(rec->name);
+            if (!*last && !(*last = add_lang(rec->name)))
+                return 0;
+        }
 
-    char *z = malloc(strlen(newn) + 1);
-    if (!z) {
-        puts("Allocation error: OOM.");
-        return 0;
+        while (rec->year >= max_year)
+            if (!new_year())
+                return 0;
+
+        set_state(*last, rec->year, rec->day, rec->s);
     }
-    strcpy(z, newn);
-    printf("Renamed lang '%s' to '%s'.\n", langs[newi].name, newn);
-    free(langs[newi].name);
-    langs[newi].name = z;
 
+    batch_sz = 0;
     return 1;
 }
 
 
-int remove_lang(const char *name) {
-    int i = index_of(name);
-    if (i < 0) {
-        printf("Error removing lang: '%s' does not exist.\n", name);
-        return 0;
-    }
+int push_record(unsigned line, lang **last,
+                const char *name, const char *year, const char *day,
+                const char *st) {
+    record *rec = &batch[batch_sz];
+    char *end;
 
-    free_lang(&langs[i]);
-    langs_sz--;
-    if (i < langs_sz)
-        memmove(&langs[i], &langs[i + 1], (langs_sz - i) * sizeof(lang));
-    langs[langs_sz] = (lang) { NULL, NULL };
-    printf("Removed lang '%s'.\n", name);
+    if (!*name)
+        return import_error(line, "missing language name");
+    if (strlen(name) > UINT8_MAX)
+        return import_error(line, "language name is too long");
+    strcpy(rec->name, name);
+
+    int y = strtol(year, &end, 10);
+    if (y > 2000)
+        y -= 2000;
+    y -= 15;
+    if (!*year || *end || y < 0 || y >= UINT8_MAX)
+        return import_error(line, "invalid year");
+    rec->year = y;
+
+    int d = strtol(day, &end, 10);
+    if (!*day || *end || d <= 0 || d >= 26)
+        return import_error(line, "invalid day");
+    rec->day = d - 1;
+
+    if (str_eq2(st, "not_yet", "."))
+        rec->s = NOT_YET;
+    else if (str_eq2(st, "started", "S"))
+        rec->s = STARTED;
+    else if (str_eq2(st, "completed", "C"))
+        rec->s = COMPLETED;
+    else
+        return import_error(line, "invalid state");
 
+    if (++batch_sz == BATCH_SZ)
+        return apply_batch(last);
     return 1;
 }
 
 
-/* (de)serialization */
+/* returns the number of imported records, or -1 on error */
+long import_csv(reader *r, lang **last) {
+    char f[4][UINT8_MAX + 2];
+    long count = 0;
+
+    for (int row = 0;; ++row) {
+        unsigned line = r->line;
+        int n = 0, c;
+        do {
+            c = csv_field(r, f[n], sizeof(f[n]));
+            if (!c)
+                return import_error(line, "invalid or too long field") - 1;
+            n++;
+        } while (c == ',' && n < 4);
+
+        if (c == ',')
+            return import_error(line, "too many fields (expected 4)") - 1;
+        if (n == 1 && !f[0][0]) {
+            if (c == EOF)
+                break;
+            continue;
+        }
+        if (n != 4)
+            return import_error(line, "too few fields (expected 4)") - 1;
 
-int deserialize() {
-    if (edit_mode)
-        return 1;
+        if (row || !str_eq1(f[0], "language")) {
+            if (!push_record(line, last, f[0], f[1], f[2], f[3]))
+                return -1;
+            count++;
+        }
 
-    FILE *fp = fopen(FILENAME, "rb+");
-    if (!fp) {
-        printf("Error reading data: '%s' could not be opened.\n", FILENAME);
-        return 0;
+        if (c == EOF)
+            break;
     }
 
-    fseek(fp, 0, SEEK_END);
-    size_t sz = ftell(fp);
-    if (!sz)
-        goto invalid_file;
-    rewind(fp);
+    return count;
+}
 
-    max_year = fgetc(fp);
-    if (max_year) {
-        size_t est_sz = sz / (max_year * 8);
-        if (est_sz && !resize_langs(est_sz)) {
-            fclose(fp);
-            return 0;
+
+/* returns the number of imported records, or -1 on error */
+long import_json(reader *r, lang **last) {
+    char f[4][UINT8_MAX + 2];
+    char z[UINT8_MAX + 2];
+    long count = 0;
+    token t;
+
+    while ((t = json_next(r, z, sizeof(z))) != TK_EOF) {
+        if (t == TK_PUNCT && (z[0] == '[' || z[0] == ']' || z[0] == ','))
+            continue;
+        if (t != TK_PUNCT || z[0] != '{')
+            return import_error(r->line, "expected an object") - 1;
+
+        for (int i = 0; i < 4; ++i)
+            f[i][0] = '\0';
+
+        int k;
+        while ((k = json_key(r, z, sizeof(z))) > 0) {
+            int i = str_eq1(z, "language") ? 0
+                  : str_eq1(z, "year")     ? 1
+                  : str_eq1(z, "day")      ? 2
+                  : str_eq1(z, "state")    ? 3 : -1;
+
+            t = json_next(r, i < 0 ? z : f[i], sizeof(z));
+            if (i < 0) {
+                if (!json_skip(r, t, z))
+                    return import_error(r->line, "invalid value") - 1;
+            } else if (t != TK_STRING && t != TK_NUMBER && t != TK_LITERAL)
+                return import_error(r->line, "expected a string or a number") - 1;
         }
+        if (k < 0)
+            return import_error(r->line, "expected a key") - 1;
+
+        if (!push_record(r->line, last, f[0], f[1], f[2], f[3]))
+            return -1;
+        count++;
     }
 
-    char name[UINT8_MAX];
-    memset(name, 0, sizeof(name));
+    return count;
+}
 
-    while (sz - ftell(fp) > 0) {
-        uint8_t name_sz = fgetc(fp);
-        if (!name_sz || sz - ftell(fp) < name_sz + max_year * sizeof(int64_t))
-            goto invalid_file;
 
-        fread(name, 1, name_sz, fp);
-        name[name_sz] = '\0';
+/* completion_day_level: { "day": { "level": { ... }, ... }, ... } */
+int sync_days(reader *r, uint64_t *word) {
+    char z[UINT8_MAX + 2];
+    int k, l;
 
-        lang *l = add_lang(name);
-        if (!l)
-            goto invalid_file;
+    if (!json_open(r))
+        return 0;
 
-        if (max_year)
-            fread(l->bits, sizeof(int64_t), max_year, fp);
-    }
+    while ((k = json_key(r, z, sizeof(z))) > 0) {
+        int d = strtol(z, NULL, 10) - 1;
+        int stars = 0;
 
-    fclose(fp);
-    return 1;
+        if (!json_open(r))
+            return 0;
+        while ((l = json_key(r, z, sizeof(z))) > 0) {
+            if (str_eq1(z, "1"))
+                stars |= 1;
+            else if (str_eq1(z, "2"))
+                stars |= 2;
+            token t = json_next(r, z, sizeof(z));
+            if (!json_skip(r, t, z))
+                return 0;
+        }
+        if (l < 0)
+            return 0;
 
-    invalid_file:
-    printf("Error reading data: '%s' contains invalid data.\n", FILENAME);
-    fclose(fp);
-    return 0;
+        if (d >= 0 && d < 25 && stars)
+            SET(*word, (d << 1) + !(stars & 2));
+    }
+
+    return !k;
 }
 
 
-int serialize() {
-    if (edit_mode)
-        return 1;
+/* ORs the stars of the member into word if it matches the filter */
+int sync_member(reader *r, const char *key, const char *filter,
+                uint64_t *word, int *found) {
+    char z[UINT8_MAX + 2], name[UINT8_MAX + 2] = "", id[32] = "";
+    uint64_t w = 0;
+    int k;
 
-    FILE *fp = fopen(FILENAME, "wb");
-    if (!fp) {
-        printf("Error saving data: '%s' could not be opened.\n", FILENAME);
+    if (!json_open(r))
         return 0;
-    }
 
-    fputc(max_year, fp);
+    while ((k = json_key(r, z, sizeof(z))) > 0) {
+        if (str_eq1(z, "completion_day_level")) {
+            if (!sync_days(r, &w))
+                return 0;
+            continue;
+        }
 
-    for (int i = 0; i < langs_sz; ++i) {
-        uint8_t sz = strlen(langs[i].name);
-        if (!fputc(sz, fp)
-            || !fwrite(langs[i].name, 1, sz, fp)
-            || !fwrite(langs[i].bits, 1, max_year * sizeof(uint64_t), fp))
-            goto failure;
+        char *v = str_eq1(z, "name") ? name : str_eq1(z, "id") ? id : z;
+        size_t sz = v == id ? sizeof(id) : sizeof(z);
+        token t = json_next(r, v, sz);
+        if (!json_skip(r, t, v))
+            return 0;
+        if (t != TK_STRING && t != TK_NUMBER)
+            v[0] = '\0';
     }
+    if (k < 0)
+        return 0;
 
-    fclose(fp);
-    printf("Saved data to '%s'.\n", FILENAME);
+    if (!filter || str_eq1(filter, key) || str_eq1(filter, name)
+        || !strcmp(filter, id)) {
+        *word |= w;
+        (*found)++;
+    }
     return 1;
-
-    failure:
-    printf("Error saving data: could not write to '%s'.\n", FILENAME);
-    fclose(fp);
-    return 0;
 }
 
 
-/* print */
+/*
+ * Streams an advent of code private leaderboard, ORing the stars of every
+ * matching member into word and storing the year index of the event in year.
+ */
+int sync_leaderboard(reader *r, const char *filter,
+                     uint64_t *word, int *year, int *found) {
+    char z[UINT8_MAX + 2], key[UINT8_MAX + 2];
+    int k, m;
 
-void print(uint64_t fl, uint64_t fy, uint32_t fd) {
-    int max_length = 4;
+    if (!json_open(r))
+        return 0;
 
-    for (int i = 0; i < langs_sz; ++i) {
-        if (!IS_SET(fl, i))
+    while ((k = json_key(r, key, sizeof(key))) > 0) {
+        if (str_eq1(key, "members")) {
+            if (!json_open(r))
+                return 0;
+            while ((m = json_key(r, z, sizeof(z))) > 0)
+                if (!sync_member(r, z, filter, word, found))
+                    return 0;
+            if (m < 0)
+                return 0;
             continue;
-        int n = strlen(langs[i].name);
-        max_length = (n > max_length) ? n : max_length;
+        }
+
+        token t = json_next(r, z, sizeof(z));
+        if (!json_skip(r, t, z))
+            return 0;
+        if (str_eq1(key, "event") && (t == TK_STRING || t == TK_NUMBER))
+            *year = strtol(z, NULL, 10) - 2015;
     }
 
-    int line_length = max_length + 2;
-    for (int i = 0; i < 25; ++i)
-        if (IS_SET(fd, i))
-            line_length += 3;
+    return !k;
+}
 
-    for (int z = 0; z < langs_sz; ++z) {
-        if (!IS_SET( fl, z))
-            continue;
 
-        printf("%*s |", max_length, langs[z].name);
-        for (int day = 0; day < 25; ++day)
-            if (IS_SET(fd, day))
-                printf(" %2d", day + 1);
-        putchar('\n');
-        for (int i = 0; i < line_length; ++i)
-            putchar('_');
-        putchar('\n');
+/* diff / merge */
 
-        for (int year = 0; year < max_year; ++year) {
-            if (!IS_SET(fy, year))
-                continue;
-            printf("%*d |", max_length, YEAR(year));
-            for (int day = 0; day < 25; ++day)
-                if (IS_SET(fd, day))
-                    printf("  %c", get_state(&langs[z], year, day));
-            putchar('\n');
-        }
-        putchar('\n');
+/* both bits of every day that has a bit set in x */
+static inline uint64_t cells(uint64_t x) {
+    x = (x | (x >> 1)) & DAY_BITS;
+    return x | (x << 1);
+}
+
+
+static inline state cell_state(uint64_t w, int day) {
+    return IS_SET(w, day << 1) ? COMPLETED : IS_SET(w, (day << 1) + 1) ? STARTED : NOT_YET;
+}
+
+
+/*
+ * Reads the next language of a stream, which must come after the previous one
+ * for the merge-join to be valid. A stream without a file is empty.
+ */
+int join_next(stream *s, int *done) {
+    char prev[UINT8_MAX + 1];
+    if (*done || !s->fp)
+        return *done = 1, 1;
+
+    strcpy(prev, s->name);
+    if (!prev[0])
+        memset(&s->words[s->years], 0, (UINT8_MAX - s->years) * sizeof(uint64_t));
+    int r = stream_next(s);
+    if (r < 0 || (r && prev[0] && strcasecmp(prev, s->name) >= 0))
+        return 0;
+    *done = !r;
+    return 1;
+}
+
+
+/* order of the current languages of a and b, with finished streams last */
+static inline int join_cmp(const stream *a, int a_done, const stream *b, int b_done) {
+    if (a_done || b_done)
+        return a_done - b_done;
+    return strcasecmp(a->name, b->name);
+}
+
+
+/* prints the days that differ between a and b, returns their count */
+long diff_words(const char *name, const uint64_t *a, const uint64_t *b, int years) {
+    long n = 0;
+    for (int y = 0; y < years; ++y) {
+        uint32_t d = compact(cells(a[y] ^ b[y]));
+        for (int day = 0; d; ++day, d >>= 1)
+            if (d & 1) {
+                printf(
+                    "  %d %02d %s: %s -> %s\n", YEAR(y), day + 1, name,
+                    state_name(cell_state(a[y], day)), state_name(cell_state(b[y], day))
+                );
+                n++;
+            }
     }
+    return n;
+}
+
+
+/*
+ * Three way merge of a year word: days changed on one side only take that
+ * side's state, days changed on both sides are completed if either side
+ * completed them, else started if either side started them. Returns the
+ * merged word and adds the number of conflicting days to conflicts.
+ */
+uint64_t merge_word(uint64_t base, uint64_t ours, uint64_t theirs, long *conflicts) {
+    uint64_t co = cells(ours ^ base), ct = cells(theirs ^ base);
+    uint64_t both = co & ct;
+    uint64_t w = (ours & ~ct) | (theirs & ct & ~co);
+
+    uint64_t c = (ours | theirs) & DAY_BITS;
+    uint64_t st = ((ours | theirs) >> 1) & DAY_BITS & ~c;
+    w |= (c | (st << 1)) & both;
+
+    *conflicts += popcount(cells(ours ^ theirs) & both & DAY_BITS);
+    return w;
+}
+
+
+static inline int words_eq(const uint64_t *a, const uint64_t *b, int years) {
+    return !memcmp(a, b, years * sizeof(uint64_t));
+}
+
+
+int write_lang(FILE *fp, const char *name, const uint64_t *words, int years) {
+    uint8_t n = strlen(name);
+    return fputc(n, fp) != EOF && fwrite(name, 1, n, fp) == n
+        && fwrite(words, sizeof(uint64_t), years, fp) == (size_t) years;
 }
 
 
@@ -463,7 +2979,7 @@ void dispatch_cmd(int argc, char **argv);
 
 
 int parse_filters(int argc, char **argv,
-                  uint64_t *tl, uint64_t *ty, uint32_t *td, uint8_t *ts) {
+                  uint64_t **tl, uint64_t *ty, uint32_t *td, uint8_t *ts) {
     for (int i = 0; i < argc;) {
         if (str_eq2(argv[i], "-d", "--days")) {
             if (*td == UINT32_MAX)
@@ -475,14 +2991,13 @@ int parse_filters(int argc, char **argv,
                     SET(*td, d);
             }
         } else if (str_eq2(argv[i], "-l", "--langs")) {
-            if (*tl == UINT64_MAX)
-                *tl = 0;
-            i++;
-            for (; i < argc && strncmp(argv[i], "-", 1); i++) {
-                int n = index_of(argv[i]);
-                if (n >= 0)
-                    SET(*tl, n);
+            if (!*tl && !(*tl = calloc(langs_sz / 64 + 1, sizeof(uint64_t)))) {
+                puts("Allocation error: OOM.");
+                return 0;
             }
+            i++;
+            for (; i < argc && strncmp(argv[i], "-", 1); i++)
+                select_langs(*tl, argv[i]);
         } else if (str_eq2(argv[i], "-y", "--years")) {
             if (*ty == UINT64_MAX)
                 *ty = 0;
@@ -522,7 +3037,12 @@ int parse_filters(int argc, char **argv,
 
 void cmd_help() {
     static const char *help =
-        "Usage:\n"
+        "Usage: [-p, --profile P] command\n"
+        "   With a profile 'P' (or if the 'AOC_HOME' environment variable is set,\n"
+        "   in which case 'P' defaults to the current user), data is stored in\n"
+        "   the 'AOC_HOME' (default '" HOMEDIR "') directory, in a file shared by\n"
+        "   no other profile. 'init' adds the profile to the directory manifest.\n"
+        "   Profile names are case insensitive.\n"
         "\nadd l1 l2 ... lN\n"
         "   Add languages 'l1' to 'ln'. Case is respected.\n"
         "   (Note: a language name may be at most 255 characters long.)\n"
@@ -536,15 +3056,26 @@ void cmd_help() {
         "   * `YYYY` being the year (both `YYYY` and `YY` are accepted).\n"
         "   * `DD` being the day (ranges from '1' to '25').\n"
         "   * `L` being the language name (case insensitive).\n"
+        "\ndiff A B\n"
+        "   Show the languages and days that differ between the data files 'A'\n"
+        "   and 'B'.\n"
         "\nedit\n"
         "   Enter edit mode, which enables the following additional commands:\n"
         "   (Note: commands entered in edit may be at most 255 characters long.)\n"
         "   * exit\n"
         "     Exit edit mode without saving.\n"
+        "   * redo\n"
+        "     Redo the last undone command.\n"
         "   * reload\n"
         "     Reload data from the file without saving.\n"
         "   * save\n"
         "     Save data to the file.\n"
+        "   * undo\n"
+        "     Undo the last command that changed data. Only the most recent\n"
+        "     changes are kept (a command changing too much cannot be undone).\n"
+        "\nexport [-f, --format csv | json]\n"
+        "   Write every started or completed day to the standard output, one\n"
+        "   'language, year, day, state' record per row. Defaults to csv.\n"
         "\nfile\n"
         "   Show the data file name.\n"
         "\nget\n"
@@ -552,7 +3083,9 @@ void cmd_help() {
         "   * -d, --days d1 d2 ... dN\n"
         "     Restrict to the days 'd1', 'd2', etc. Ranges from '1' to '25'.\n"
         "   * -l, --langs l1 l2 ... lN\n"
-        "     Restrict to the languages 'l1', 'l2', etc. Case is ignored.\n"
+        "     Restrict to the languages 'l1', 'l2', etc. Case is ignored. Names may\n"
+        "     contain '*' and '?' wildcards (e.g 'C*' for every name starting\n"
+        "     with 'C').\n"
         "   * -y, --years y1 y2 ... yN\n"
         "     Restrict to the years 'y1', 'y2', etc. Ranges from '15' to max year.\n"
         "     Both `YY` and `YYYY` are accepted. (e.g '17' and '2017')\n"
@@ -560,10 +3093,46 @@ void cmd_help() {
         "     Restrict to the states 's1', 's2', etc. Correct values: 'not_yet',\n"
         "     'started', 'completed' (case is ignored). If unspecified, defaults to\n"
         "     'not_yet'.\n"
+        "   * -n, --count K\n"
+        "     Get 'K' distinct combinations instead of one.\n"
+        "   * -w, --weights w1 w2 ... wN\n"
+        "     Make some combinations more likely. Correct values: 'early' (earlier\n"
+        "     days), 'years' (later years), 'langs' (languages with fewer completed\n"
+        "     days), 'fresh' (avoid the last 64 suggestions, which are recorded\n"
+        "     next to the data file once 'fresh' has been used).\n"
         "\nh, help, -h, --help\n"
         "   Show this message.\n"
+        "\nhistory [log | weekly | time] [-f, --from D] [-t, --to D]\n"
+        "   Show the recorded state changes, restricted to the dates 'D' to 'D'\n"
+        "   (both 'YYYY-MM-DD', UTC, inclusive) if given.\n"
+        "   * log\n"
+        "     List every change (default).\n"
+        "   * weekly\n"
+        "     Count completions per week.\n"
+        "   * time\n"
+        "     Show the time between the start and the completion of each day.\n"
+        "\nimport F\n"
+        "   Apply the records of the csv or json file 'F' (as written by export).\n"
+        "   Missing languages and years are added. States may also be written as\n"
+        "   '.', 'S' and 'C'.\n"
         "\ninit\n"
         "   Create and initialize the data file.\n"
+        "\nmerge B O T\n"
+        "   Merge the changes made between the data files 'B' and 'T' into 'O'.\n"
+        "   Days changed in both are completed if either completed them, else\n"
+        "   started. Languages removed on one side and unchanged on the other\n"
+        "   are removed. Can be used as a git merge driver ('aoc merge %O %A %B').\n"
+        "\nquery E\n"
+        "   Show the days of each language matching the expression 'E', built\n"
+        "   from 'and', 'or', 'not', parentheses and the following:\n"
+        "   * completed(Y), started(Y), not_yet(Y)\n"
+        "     Days of the year 'Y' in the given state. 'Y' may be '*' for any\n"
+        "     year. A language may be given as a second argument (e.g\n"
+        "     'started(2021, Rust)'), the predicate then gives the days of that\n"
+        "     language whatever the language being matched.\n"
+        "   * all(E), any(E)\n"
+        "     Every day if 'E' matches every day (resp. at least one), else none.\n"
+        "   (e.g 'all(completed(2022))' lists languages with 2022 completed.)\n"
         "\nrandom\n"
         "   Alias for get.\n"
         "\nrename old new\n"
@@ -575,7 +3144,8 @@ void cmd_help() {
         "   * -d, --days d1 d2 ... dN\n"
         "     Only show the days 'd1', 'd2', etc. Ranges from '1' to '25'.\n"
         "   * -l, --langs l1 l2 ... lN\n"
-        "     Only show the languages 'l1', 'l2', etc. Case is ignored.\n"
+        "     Only show the languages 'l1', 'l2', etc. Case is ignored. Names may\n"
+        "     contain '*' and '?' wildcards.\n"
         "   * -y, --years y1 y2 ... yN\n"
         "     Only show the years 'y1', 'y2', etc. Ranges from '15' to max year.\n"
         "     Both `YY` and `YYYY` are accepted. (e.g '17' and '2017')\n"
@@ -584,6 +3154,17 @@ void cmd_help() {
         "   * `YYYY` being the year (both `YYYY` and `YY` are accepted).\n"
         "   * `DD` being the day (ranges from '1' to '25').\n"
         "   * `L` being the language name (case insensitive).\n"
+        "\nsync F L [M]\n"
+        "   Mark the days of the advent of code private leaderboard json file 'F'\n"
+        "   as completed (2 stars) or started (1 star) for language 'L'. Only\n"
+        "   the member 'M' (name or id) is used if given, otherwise every member.\n"
+        "   Days are never downgraded.\n"
+        "\nteam show | stats\n"
+        "   Operations over every profile of the manifest, one at a time.\n"
+        "   * show\n"
+        "     Show the progress of each profile. Accepts the filters of show.\n"
+        "   * stats\n"
+        "     Count languages, started and completed days of each profile.\n"
         "\nyear\n"
         "   Year related operations. The following options are exclusive.\n"
         "   * add\n"
@@ -595,6 +3176,186 @@ void cmd_help() {
 }
 
 
+void complete_langs(const char *cur) {
+    char name[UINT8_MAX + 1];
+    size_t n = strlen(cur);
+    uint8_t years;
+    int words;
+    FILE *fp = open_names(&years, &words);
+    if (!fp)
+        return;
+
+    /* names are sorted, stop after the ones starting with cur */
+    while (next_name(fp, words, name)) {
+        int c = strncasecmp(name, cur, n);
+        if (c > 0)
+            break;
+        if (!c)
+            puts(name);
+    }
+    fclose(fp);
+}
+
+
+void complete_years(const char *cur) {
+    uint8_t years;
+    int words;
+    FILE *fp = open_names(&years, &words);
+    if (!fp)
+        return;
+    fclose(fp);
+
+    char z[8];
+    for (int y = 0; y < years; ++y) {
+        snprintf(z, sizeof(z), "%d", YEAR(y));
+        if (!strncmp(z, cur, strlen(cur)))
+            puts(z);
+    }
+}
+
+
+void complete_words(const char *cur, const char *const *words) {
+    for (; *words; ++words)
+        if (!strncasecmp(*words, cur, strlen(cur)))
+            puts(*words);
+}
+
+
+/*
+ * Prints the completions of the last argument, given the arguments before it.
+ * Only the language names are read (from the index file if possible).
+ */
+void cmd_complete(int argc, char **argv) {
+    static const char *const cmds[] = {
+        "add", "clear", "complete", "diff", "edit", "export", "file", "get",
+        "help", "history", "import", "init", "merge", "query", "random",
+        "rename", "rm", "show", "start", "sync", "team", "year", NULL
+    };
+    static const char *const days[] = {
+        "1", "2", "3", "4", "5", "6", "7", "8", "9", "10", "11", "12", "13",
+        "14", "15", "16", "17", "18", "19", "20", "21", "22", "23", "24", "25",
+        NULL
+    };
+    static const char *const filters[] = {
+        "--days", "--langs", "--states", "--years", "--count", "--weights", NULL
+    };
+    static const char *const states[] = { "not_yet", "started", "completed", NULL };
+    static const char *const weights[] = { "early", "years", "langs", "fresh", NULL };
+
+    if (argc > 2 && str_eq2(argv[0], "-p", "--profile")) {
+        if (!valid_profile(argv[1]) || !select_profile(argv[1]))
+            return;
+        argc -= 2;
+        argv += 2;
+    }
+    if (!argc)
+        return;
+
+    const char *cur = argv[argc - 1];
+    if (argc == 1) {
+        complete_words(cur, cmds);
+        return;
+    }
+
+    const char *cmd = argv[0];
+    int pos = argc - 1;
+    if (str_eq2(cmd, "clear", "complete") || str_eq1(cmd, "start")) {
+        if (pos == 1)
+            complete_years(cur);
+        else if (pos == 2)
+            complete_words(cur, days);
+        else if (pos == 3)
+            complete_langs(cur);
+    } else if (str_eq1(cmd, "rm") || (str_eq1(cmd, "rename") && pos == 1)
+               || (str_eq1(cmd, "sync") && pos == 2))
+        complete_langs(cur);
+    else if (str_eq2(cmd, "show", "get") || str_eq1(cmd, "random")) {
+        const char *opt = "";
+        for (int i = pos - 1; i > 0 && !*opt; --i)
+            if (argv[i][0] == '-')
+                opt = argv[i];
+        if (cur[0] == '-')
+            complete_words(cur, filters);
+        else if (str_eq2(opt, "-l", "--langs"))
+            complete_langs(cur);
+        else if (str_eq2(opt, "-y", "--years"))
+            complete_years(cur);
+        else if (str_eq2(opt, "-d", "--days"))
+            complete_words(cur, days);
+        else if (str_eq2(opt, "-s", "--states"))
+            complete_words(cur, states);
+        else if (str_eq2(opt, "-w", "--weights"))
+            complete_words(cur, weights);
+    } else if (str_eq1(cmd, "year") && pos == 1) {
+        static const char *const ops[] = { "add", "rm", NULL };
+        complete_words(cur, ops);
+    } else if (str_eq1(cmd, "team") && pos == 1) {
+        static const char *const ops[] = { "show", "stats", NULL };
+        complete_words(cur, ops);
+    } else if (str_eq1(cmd, "history")) {
+        static const char *const ops[] = { "log", "weekly", "time", "--from", "--to", NULL };
+        complete_words(cur, ops);
+    } else if (str_eq1(cmd, "export")) {
+        static const char *const ops[] = { "--format", NULL };
+        static const char *const formats[] = { "csv", "json", NULL };
+        complete_words(cur, str_eq2(argv[pos - 1], "-f", "--format") ? formats : ops);
+    }
+}
+
+
+void cmd_diff(int argc, char **argv) {
+    static stream a, b;
+    int a_done = 0, b_done = 0;
+
+    if (argc != 2) {
+        printf("Incorrect argument count: %d (expected 2).\n", argc);
+        return;
+    }
+    for (int i = 0; i < 2; ++i)
+        if (!stream_open(i ? &b : &a, argv[i])) {
+            printf("Error reading data: '%s' could not be opened.\n", argv[i]);
+            if (i)
+                fclose(a.fp);
+            return;
+        }
+
+    int years = a.years > b.years ? a.years : b.years;
+    long days = 0, added = 0, removed = 0;
+    const char *invalid = NULL;
+
+    if (!join_next(&a, &a_done))
+        invalid = argv[0];
+    else if (!join_next(&b, &b_done))
+        invalid = argv[1];
+    while (!invalid && !(a_done && b_done)) {
+        int c = join_cmp(&a, a_done, &b, b_done);
+        if (c < 0) {
+            printf("- %s\n", a.name);
+            removed++;
+        } else if (c > 0) {
+            printf("+ %s\n", b.name);
+            added++;
+        } else
+            days += diff_words(a.name, a.words, b.words, years);
+
+        if (c <= 0 && !join_next(&a, &a_done))
+            invalid = argv[0];
+        else if (c >= 0 && !join_next(&b, &b_done))
+            invalid = argv[1];
+    }
+    fclose(a.fp);
+    fclose(b.fp);
+
+    if (invalid)
+        printf("Error reading data: '%s' contains invalid or unsorted data.\n", invalid);
+    else
+        printf(
+            "%ld day(s) differ, %ld language(s) added, %ld removed.\n",
+            days, added, removed
+        );
+}
+
+
 void cmd_edit() {
     if (edit_mode)
         return;
@@ -648,6 +3409,7 @@ void cmd_edit() {
             for (; c < UINT8_MAX && cmd[c] != '\0'; ++c);
         }
 
+        undo_step++;
         dispatch_cmd(argc, argv);
         for (int i = 0; i < argc; ++i)
             argv[i] = NULL;
@@ -656,13 +3418,177 @@ void cmd_edit() {
 
 
 static inline void cmd_exit() {
+    undo_clear();
     edit_mode = 0;
     puts("Exited edit mode.");
 }
 
 
+void cmd_export(int argc, char **argv) {
+    int json = 0;
+    if (argc == 2 && str_eq2(argv[0], "-f", "--format")) {
+        if (str_eq1(argv[1], "json"))
+            json = 1;
+        else if (!str_eq1(argv[1], "csv")) {
+            printf(
+                "Unknown format: '%s' (expected 'csv' or 'json').\n", argv[1]
+            );
+            return;
+        }
+    } else if (argc) {
+        printf("Unknown argument: '%s' (expected '-f').\n", argv[0]);
+        return;
+    }
+
+    if (!deserialize())
+        return;
+
+    int first = 1;
+    out_puts(json ? "[" : "language,year,day,state\n");
+    for (size_t i = 0; i < langs_sz; ++i) {
+        for (int y = 0; y < max_year; ++y) {
+            if (!WORD(&langs[i], y))
+                continue;
+            for (int d = 0; d < 25; ++d) {
+                state s = get_state(&langs[i], y, d);
+                if (s == NOT_YET)
+                    continue;
+                if (json) {
+                    out_puts(first ? "\n  {\"language\": " : ",\n  {\"language\": ");
+                    out_json_str(langs[i].name);
+                    out_puts(", \"year\": ");
+                    out_uint(YEAR(y));
+                    out_puts(", \"day\": ");
+                    out_uint(d + 1);
+                    out_puts(", \"state\": \"");
+                    out_puts(state_name(s));
+                    out_puts("\"}");
+                } else {
+                    out_csv_str(langs[i].name);
+                    out_putc(',');
+                    out_uint(YEAR(y));
+                    out_putc(',');
+                    out_uint(d + 1);
+                    out_putc(',');
+                    out_puts(state_name(s));
+                    out_putc('\n');
+                }
+                first = 0;
+            }
+        }
+    }
+    if (json)
+        out_puts(first ? "]\n" : "\n]\n");
+    out_flush();
+}
+
+
 static inline void cmd_file() {
-    puts(FILENAME);
+    puts(filename);
+}
+
+
+int cmp_size(const void *a, const void *b) {
+    size_t x = *(const size_t *) a, y = *(const size_t *) b;
+    return (x > y) - (x < y);
+}
+
+
+static inline size_t rank_slot(size_t r, size_t cap) {
+    return (size_t) (((uint64_t) r * UINT64_C(0x9E3779B97F4A7C15)) >> 32) & (cap - 1);
+}
+
+
+/*
+ * Draws k distinct ranks below n, sorted, with Floyd's algorithm: one draw per
+ * rank, kept in an open addressing set. Returns 0 on allocation failure.
+ */
+int draw_ranks(size_t *ranks, size_t k, size_t n) {
+    size_t cap = 16;
+    while (cap < 2 * k)
+        cap *= 2;
+    size_t *set = malloc(cap * sizeof(size_t));
+    if (!set) {
+        puts("Allocation error: OOM.");
+        return 0;
+    }
+    memset(set, 0xFF, cap * sizeof(size_t));
+
+    /* j itself cannot be in the set yet, as every previous draw was below j */
+    for (size_t j = n - k; j < n; ++j) {
+        size_t t = random(j + 1), i = rank_slot(t, cap);
+        for (; set[i] != SIZE_MAX && set[i] != t; i = (i + 1) & (cap - 1));
+        if (set[i] == t)
+            for (t = j, i = rank_slot(t, cap); set[i] != SIZE_MAX; i = (i + 1) & (cap - 1));
+        set[i] = t;
+    }
+
+    size_t got = 0;
+    for (size_t i = 0; i < cap; ++i)
+        if (set[i] != SIZE_MAX)
+            ranks[got++] = set[i];
+    free(set);
+    qsort(ranks, k, sizeof(size_t), cmp_size);
+    return 1;
+}
+
+
+/*
+ * Uniform draw of k matches without building the candidates: counts them, draws
+ * k distinct ranks, and locates each rank in a second scan.
+ */
+void get_uniform(scan *sc, const uint64_t *fl, uint64_t fy, const uint64_t *sel, long k) {
+    size_t n = 0;
+    scan_start(sc, fl, fy);
+    while (scan_next(sc))
+        n += kern.match(sc->w, sc->n, sel, NULL);
+    if (!n) {
+        puts("No match found.");
+        return;
+    }
+    if (k > n)
+        k = n;
+
+    size_t *ranks = malloc(k * sizeof(size_t));
+    pick *out = malloc(k * sizeof(pick));
+    if (!ranks || !out) {
+        puts("Allocation error: OOM.");
+        goto end;
+    }
+
+    if (!draw_ranks(ranks, k, n))
+        goto end;
+
+    size_t seen = 0, got = 0;
+    scan_start(sc, fl, fy);
+    while (got < k && scan_next(sc)) {
+        size_t c = kern.match(sc->w, sc->n, sel, sc->m);
+        /* matches before the word j of this scan */
+        size_t j = 0, before = seen;
+        for (; got < k && ranks[got] < seen + c; ++got) {
+            size_t r = ranks[got] - before;
+            j += kern.locate(&sc->m[j], sc->n - j, &r);
+            before = ranks[got] - r;
+            out[got] = sc->at[j];
+            out[got].day = nth_day(sc->m[j], r);
+        }
+        seen += c;
+    }
+
+    /* the ranks were sorted */
+    for (size_t i = k - 1; i > 0; --i) {
+        size_t j = random(i + 1);
+        pick p = out[i];
+        out[i] = out[j];
+        out[j] = p;
+    }
+    for (long i = 0; i < k; ++i)
+        printf("%d %02d %s\n", YEAR(out[i].year), out[i].day + 1, langs[out[i].lang].name);
+    save_recent(out, k, 0);
+
+    end:
+    free(ranks);
+    free(out);
 }
 
 
@@ -670,20 +3596,57 @@ void cmd_get(int argc, char **argv) {
     if (!deserialize())
         return;
 
-    uint64_t tl = UINT64_MAX;
+    uint64_t *tl = NULL;
     uint64_t ty = UINT64_MAX;
     uint32_t td = UINT32_MAX;
     uint8_t  ts = UINT8_MAX;
+    long k = 1;
+    int weights = 0;
+
+    /* keep the filters for parse_filters */
+    int argn = 0;
+    for (int i = 0; i < argc;) {
+        if (str_eq2(argv[i], "-n", "--count")) {
+            if (i + 1 == argc || (k = strtol(argv[i + 1], NULL, 10)) < 1) {
+                printf("Incorrect count: expected a number after '%s'.\n", argv[i]);
+                return;
+            }
+            i += 2;
+        } else if (str_eq2(argv[i], "-w", "--weights")) {
+            for (i++; i < argc && strncmp(argv[i], "-", 1); i++) {
+                if (str_eq1(argv[i], "early"))
+                    weights |= W_EARLY;
+                else if (str_eq1(argv[i], "years"))
+                    weights |= W_YEARS;
+                else if (str_eq1(argv[i], "langs"))
+                    weights |= W_LANGS;
+                else if (str_eq1(argv[i], "fresh"))
+                    weights |= W_FRESH;
+                else {
+                    printf(
+                        "Unknown weight: '%s' (expected 'early', 'years', "
+                        "'langs' or 'fresh').\n", argv[i]
+                    );
+                    return;
+                }
+            }
+        } else
+            argv[argn++] = argv[i++];
+    }
 
-    if (argc) {
-        if (!parse_filters(argc, argv, &tl, &ty, &td, &ts))
+    if (argn) {
+        if (!parse_filters(argn, argv, &tl, &ty, &td, &ts)) {
+            free(tl);
             return;
+        }
 
-        if (!tl || !ty || !td || !ts) {
+        if (!ty || !td || !ts) {
+            free(tl);
             puts("No match found.");
             return;
         }
-    } else {
+    }
+    if (ts == UINT8_MAX) {
         ts = 0;
         SET(ts, 0);
     }
@@ -691,56 +3654,273 @@ void cmd_get(int argc, char **argv) {
     if (!edit_mode)
         srand(time((NULL)));
 
-    int n = 0;
-    int nl = -1, ny = -1, nd = -1;
-    for (int l = 0; l < langs_sz; ++l) {
-        if (!IS_SET(tl, l))
+    static scan sc;
+    uint64_t sel[3];
+    select_days(sel, ts, td);
+
+    if (!weights) {
+        get_uniform(&sc, tl, ty, sel, k);
+        free(tl);
+        return;
+    }
+
+    pick *cand = NULL;
+    size_t n = 0, alloc = 0;
+    scan_start(&sc, tl, ty);
+    while (scan_next(&sc)) {
+        size_t c = kern.match(sc.w, sc.n, sel, sc.m);
+        if (!c)
             continue;
-        for (int y = 0; y < max_year; ++y) {
-            if (!IS_SET(ty, y))
-                continue;
-            for (int d = 0; d < 25; ++d) {
-                if (!IS_SET(td, d))
-                    continue;
-                state s = get_state(&langs[l], y, d);
-                if ((s == NOT_YET   && IS_SET(ts, 0))
-                    || (s == STARTED   && IS_SET(ts, 1))
-                    || (s == COMPLETED && IS_SET(ts, 2))) {
-                    n++;
-                    if (!random(n)) {
-                        nl = l; ny = y; nd = d;
-                    }
-                }
-            }
+        if (!grow((void **) &cand, &alloc, n + c, sizeof(pick))) {
+            free(cand);
+            free(tl);
+            return;
         }
+        for (size_t i = 0; i < sc.n; ++i)
+            for (uint64_t m = sc.m[i]; m; m &= m - 1) {
+                cand[n] = sc.at[i];
+                cand[n++].day = popcount((m & -m) - 1) >> 1;
+            }
     }
 
-    if (nl >= 0)
-        printf("%d %02d %s\n", YEAR(ny), nd + 1, langs[nl].name);
-    else
+    free(tl);
+    if (!n) {
         puts("No match found.");
+        return;
+    }
+    if (k > n)
+        k = n;
+
+    double *w = malloc(n * sizeof(double)), *prob = malloc(n * sizeof(double));
+    size_t *alias = malloc(n * sizeof(size_t));
+    int *done = weights & W_LANGS ? malloc(langs_sz * sizeof(int)) : NULL;
+    char *taken = calloc(n, 1);
+    pick *out = malloc(k * sizeof(pick));
+    if (!w || !prob || !alias || !taken || !out || (weights & W_LANGS && !done)) {
+        puts("Allocation error: OOM.");
+        goto end;
+    }
+
+    uint64_t recent[RECENT_SZ];
+    size_t nr = weights & W_FRESH ? load_recent(recent) : 0;
+    for (size_t i = 0; done && i < langs_sz; ++i)
+        done[i] = -1;
+
+    for (size_t i = 0; i < n; ++i) {
+        pick *p = &cand[i];
+        double x = 1;
+        if (weights & W_EARLY)
+            x *= 25 - p->day;
+        if (weights & W_YEARS)
+            x *= p->year + 1;
+        if (weights & W_LANGS) {
+            if (done[p->lang] < 0) {
+                uint64_t sel[3] = { 0, 0, DAY_BITS };
+                done[p->lang] = kern.match(langs[p->lang].bits, max_year, sel, NULL);
+            }
+            x /= 1 + done[p->lang];
+        }
+        uint64_t key = PICK_KEY(*p);
+        if (nr && bsearch(&key, recent, nr, sizeof(uint64_t), cmp_keys64))
+            x /= RECENT_PENALTY;
+        w[i] = x;
+    }
+
+    /* draw without replacement, dropping picked candidates when they get in the way */
+    if (!alias_build(w, n, prob, alias))
+        goto end;
+    for (size_t got = 0, misses = 0; got < k;) {
+        size_t i = alias_draw(prob, alias, n);
+        if (!taken[i]) {
+            taken[i] = 1;
+            out[got++] = cand[i];
+        } else if (++misses > 32) {
+            for (size_t j = 0; j < n; ++j)
+                if (taken[j])
+                    w[j] = 0;
+            if (!alias_build(w, n, prob, alias))
+                goto end;
+            misses = 0;
+        }
+    }
+
+    for (long i = 0; i < k; ++i)
+        printf("%d %02d %s\n", YEAR(out[i].year), out[i].day + 1, langs[out[i].lang].name);
+    save_recent(out, k, weights & W_FRESH);
+
+    end:
+    free(cand);
+    free(w);
+    free(prob);
+    free(alias);
+    free(done);
+    free(taken);
+    free(out);
+}
+
+
+void cmd_history(int argc, char **argv) {
+    int64_t from = INT64_MIN, to = INT64_MAX;
+    int mode = 0;
+
+    for (int i = 0; i < argc; ++i) {
+        if (str_eq1(argv[i], "log"))
+            mode = 0;
+        else if (str_eq1(argv[i], "weekly"))
+            mode = 1;
+        else if (str_eq1(argv[i], "time"))
+            mode = 2;
+        else if (i + 1 < argc
+                 && (str_eq2(argv[i], "-f", "--from")
+                     || str_eq2(argv[i], "-t", "--to"))) {
+            int y, m, d;
+            if (sscanf(argv[i + 1], "%d-%d-%d", &y, &m, &d) != 3
+                || m < 1 || m > 12 || d < 1 || d > 31) {
+                printf(
+                    "Incorrect date: '%s' (expected 'YYYY-MM-DD').\n",
+                    argv[i + 1]
+                );
+                return;
+            }
+            int64_t t = days_from_civil(y, m, d) * 86400;
+            if (str_eq2(argv[i], "-f", "--from"))
+                from = t;
+            else
+                to = t + 86400;
+            i++;
+        } else {
+            printf(
+                "Unknown argument: '%s' (expected 'log', 'weekly', 'time', "
+                "'-f' or '-t').\n", argv[i]
+            );
+            return;
+        }
+    }
+
+    history h = { NULL, 0, 0, NULL, NULL, 0, 0, 0 };
+    if (!hist_load(&h, 1))
+        return;
+    if (hist_sort(&h)) {
+        size_t lo = hist_lower_bound(&h, from), hi = hist_lower_bound(&h, to);
+        if (mode == 0)
+            hist_log(&h, lo, hi);
+        else if (mode == 1)
+            hist_weekly(&h, lo, hi);
+        else
+            hist_time(&h, from, to);
+    }
+    hist_free(&h);
+}
+
+
+void cmd_import(int argc, char **argv) {
+    if (argc != 1) {
+        printf("Incorrect argument count: %d (expected 1).\n", argc);
+        return;
+    }
+
+    if (!deserialize())
+        return;
+
+    static reader r;
+    r.fp = fopen(argv[0], "rb");
+    if (!r.fp) {
+        printf("Error importing data: '%s' could not be opened.\n", argv[0]);
+        return;
+    }
+    r.pos = r.len = 0;
+    r.line = 1;
+
+    int c;
+    do
+        c = rd_getc(&r);
+    while (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+    if (c != EOF)
+        rd_ungetc(&r);
+
+    lang *last = NULL;
+    batch_sz = 0;
+    quiet = 1;
+    long n = c == '[' || c == '{' ? import_json(&r, &last) : import_csv(&r, &last);
+    if (n >= 0 && !apply_batch(&last))
+        n = -1;
+    quiet = 0;
+    fclose(r.fp);
+
+    if (n < 0)
+        return;
+    printf("Imported %ld records from '%s'.\n", n, argv[0]);
+    serialize();
 }
 
 
 void cmd_init() {
-    FILE *fp = fopen(FILENAME, "r");
+    FILE *fp = fopen(filename, "r");
     if (fp) {
         fclose(fp);
-        printf("'%s' already exists.\nOverwrite? [y/N]\n", FILENAME);
+        printf("'%s' already exists.\nOverwrite? [y/N]\n", filename);
         char c;
         scanf(" %c", &c);
         if (c != 'y' && c != 'Y')
             return;
     }
 
-    fp = fopen(FILENAME, "wb");
+    if (*profile && !register_profile())
+        return;
+
+    fp = fopen(filename, "wb");
     if (!fp) {
-        printf("Error saving data: '%s' could not be opened.\n", FILENAME);
+        printf("Error saving data: '%s' could not be opened.\n", filename);
         return;
     }
     fputc(1, fp);
     fclose(fp);
-    printf("Initialized '%s'.\n", FILENAME);
+    printf("Initialized '%s'.\n", filename);
+}
+
+
+/*
+ * Checks every supported kernel level against the scalar one on random words,
+ * for each selection of states and days, count and rank.
+ */
+void cmd_kernels() {
+    static uint64_t w[SCAN_SZ], m[SCAN_SZ], ref[SCAN_SZ];
+    int levels = 0;
+    for (; levels < (int) (sizeof(kernel_levels) / sizeof(kernel_levels[0])); ++levels)
+        if (!strcmp(kernel_levels[levels].name, kern.name))
+            break;
+
+    srand(1);
+    for (int l = 1; l <= levels; ++l) {
+        const kernels *k = &kernel_levels[l];
+        long fails = 0;
+        for (int it = 0; it < 1000 && !fails; ++it) {
+            size_t n = random(SCAN_SZ + 1);
+            for (size_t i = 0; i < n; ++i) {
+                /* every other round, also set the unused bits */
+                uint64_t x = ((uint64_t) rand() << 48) ^ ((uint64_t) rand() << 24) ^ rand();
+                w[i] = it & 1 ? x : x & (DAY_BITS | DAY_BITS << 1);
+            }
+            uint64_t sel[3];
+            select_days(sel, random(8), rand() & ALL_DAYS);
+
+            size_t c = match_scalar(w, n, sel, ref);
+            if (k->match(w, n, sel, m) != c || k->match(w, n, sel, NULL) != c
+                || memcmp(m, ref, n * sizeof(uint64_t)))
+                fails++;
+            for (int j = 0; j < 16 && !fails; ++j) {
+                size_t r = random(c + 1), kr = r;
+                size_t i = locate_scalar(ref, n, &r);
+                if (k->locate(ref, n, &kr) != i || kr != r)
+                    fails++;
+            }
+        }
+        printf("%-8s %s\n", k->name, fails ? "mismatch" : "ok");
+        if (fails)
+            exit_status = EXIT_FAILURE;
+    }
+    if (!levels)
+        puts("Only the scalar kernels are in use, nothing to check.");
 }
 
 
@@ -772,8 +3952,181 @@ void cmd_lang(int argc, char **argv, int cmd) {
 }
 
 
+/*
+ * Merges the changes made from base to theirs into ours, e.g as a git merge
+ * driver: 'aoc merge %O %A %B'. The result replaces ours once fully written.
+ */
+void cmd_merge(int argc, char **argv) {
+    static stream f[3];
+    static uint64_t w[UINT8_MAX];
+    int done[3] = { 0 };
+    enum { BASE, OURS, THEIRS };
+
+    if (argc != 3) {
+        printf("Incorrect argument count: %d (expected 3).\n", argc);
+        exit_status = EXIT_FAILURE;
+        return;
+    }
+    for (int i = 0; i < 3; ++i) {
+        if (stream_open(&f[i], argv[i]))
+            continue;
+        /* git gives an empty base when both sides added the file */
+        FILE *fp = i == BASE ? fopen(argv[i], "rb") : NULL;
+        if (fp) {
+            fclose(fp);
+            f[i].years = 0;
+            continue;
+        }
+        printf("Error reading data: '%s' could not be opened.\n", argv[i]);
+        for (int j = 0; j < i; ++j)
+            if (f[j].fp)
+                fclose(f[j].fp);
+        exit_status = EXIT_FAILURE;
+        return;
+    }
+
+    char path[PATH_SZ + 8];
+    snprintf(path, sizeof(path), "%s.tmp", argv[OURS]);
+    FILE *out = fopen(path, "wb");
+    int years = 0;
+    for (int i = 0; i < 3; ++i)
+        if (f[i].years > years)
+            years = f[i].years;
+
+    long merged = 0, conflicts = 0;
+    const char *invalid = NULL;
+    int ok = out && fputc(years, out) != EOF;
+    for (int i = 0; i < 3 && !invalid; ++i)
+        if (!join_next(&f[i], &done[i]))
+            invalid = argv[i];
+
+    while (ok && !invalid && !(done[BASE] && done[OURS] && done[THEIRS])) {
+        /* the smallest current name, and which streams are on it */
+        int first = -1, on[3];
+        for (int i = 0; i < 3; ++i)
+            if (!done[i] && (first < 0 || strcasecmp(f[i].name, f[first].name) < 0))
+                first = i;
+        for (int i = 0; i < 3; ++i)
+            on[i] = !done[i] && !strcasecmp(f[i].name, f[first].name);
+
+        const uint64_t *base = on[BASE] ? f[BASE].words : w;
+        if (!on[BASE])
+            memset(w, 0, sizeof(w));
+
+        if (on[OURS] && on[THEIRS]) {
+            uint64_t m[UINT8_MAX];
+            for (int y = 0; y < years; ++y)
+                m[y] = merge_word(base[y], f[OURS].words[y], f[THEIRS].words[y], &conflicts);
+            ok = write_lang(out, f[OURS].name, m, years);
+            merged++;
+        } else if (on[OURS] || on[THEIRS]) {
+            /* removed on one side: kept only if changed on the other */
+            stream *s = &f[on[OURS] ? OURS : THEIRS];
+            if (!on[BASE] || !words_eq(base, s->words, years)) {
+                ok = write_lang(out, s->name, s->words, years);
+                merged++;
+                conflicts += on[BASE];
+            }
+        }
+
+        for (int i = 0; i < 3 && !invalid; ++i)
+            if (on[i] && !join_next(&f[i], &done[i]))
+                invalid = argv[i];
+    }
+
+    for (int i = 0; i < 3; ++i)
+        if (f[i].fp)
+            fclose(f[i].fp);
+    if (out && fclose(out))
+        ok = 0;
+
+    if (invalid || !ok) {
+        if (invalid)
+            printf("Error reading data: '%s' contains invalid or unsorted data.\n", invalid);
+        else
+            printf("Error saving data: could not write to '%s'.\n", path);
+        remove(path);
+        exit_status = EXIT_FAILURE;
+    } else if (rename(path, argv[OURS])) {
+        /* rename does not replace an existing file everywhere */
+        if (remove(argv[OURS]) || rename(path, argv[OURS])) {
+            printf("Error saving data: could not write to '%s'.\n", argv[OURS]);
+            exit_status = EXIT_FAILURE;
+            return;
+        }
+    }
+    if (exit_status != EXIT_SUCCESS)
+        return;
+
+    /* the completion index of ours is out of date */
+    snprintf(path, sizeof(path), "%s.idx", argv[OURS]);
+    remove(path);
+    printf(
+        "Merged %ld language(s) into '%s', %ld conflict(s) resolved.\n",
+        merged, argv[OURS], conflicts
+    );
+}
+
+
+void cmd_query(int argc, char **argv) {
+    if (!argc) {
+        printf("Incorrect argument count: %d (expected at least 1).\n", argc);
+        return;
+    }
+
+    char src[1024];
+    size_t n = 0;
+    for (int i = 0; i < argc; ++i) {
+        size_t sz = strlen(argv[i]);
+        if (n + sz + 1 >= sizeof(src)) {
+            puts("Error in query: query is too long.");
+            return;
+        }
+        memcpy(&src[n], argv[i], sz);
+        n += sz;
+        src[n++] = ' ';
+    }
+    src[n - 1] = '\0';
+
+    if (!deserialize())
+        return;
+
+    static query q;
+    if (!q_compile(&q, src))
+        return;
+
+    int found = 0;
+    for (size_t l = 0; l < langs_sz; ++l) {
+        uint32_t m = q_eval(&q, l);
+        if (!m)
+            continue;
+        found++;
+        printf("%s:", langs[l].name);
+        for (int d = 0; d < 25; ++d) {
+            if (!IS_SET(m, d))
+                continue;
+            int e = d;
+            for (; e < 24 && IS_SET(m, e + 1); ++e);
+            if (e > d)
+                printf(" %d-%d", d + 1, e + 1);
+            else
+                printf(" %d", d + 1);
+            d = e;
+        }
+        putchar('\n');
+    }
+
+    if (found)
+        printf("%d language%s.\n", found, found > 1 ? "s match" : " matches");
+    else
+        puts("No match found.");
+}
+
+
 static inline void cmd_reload() {
     clean_all();
+    hist_clear();
+    undo_clear();
     edit_mode = 0;
     if (deserialize())
         puts("Reloaded data.");
@@ -835,15 +4188,193 @@ void cmd_show(int argc, char **argv) {
         return;
     }
 
-    uint64_t tl = UINT64_MAX;
+    uint64_t *tl = NULL;
     uint64_t ty = UINT64_MAX;
     uint32_t td = UINT32_MAX;
     uint8_t ignored = UINT8_MAX;
 
-    if (!parse_filters(argc, argv, &tl, &tl, &td, &ignored))
+    if (parse_filters(argc, argv, &tl, &ty, &td, &ignored))
+        print(tl, ty, td);
+    free(tl);
+}
+
+
+void cmd_sync(int argc, char **argv) {
+    if (argc != 2 && argc != 3) {
+        printf("Incorrect argument count: %d (expected 2 or 3).\n", argc);
+        return;
+    }
+
+    if (!deserialize())
+        return;
+
+    lang *l = for_name(argv[1]);
+    if (!l) {
+        printf("Incorrect lang name: '%s' does not exist.\n", argv[1]);
+        return;
+    }
+
+    static reader r;
+    r.fp = fopen(argv[0], "rb");
+    if (!r.fp) {
+        printf("Error syncing data: '%s' could not be opened.\n", argv[0]);
+        return;
+    }
+    r.pos = r.len = 0;
+    r.line = 1;
+
+    uint64_t word = 0;
+    int year = -1, found = 0;
+    int ok = sync_leaderboard(&r, argc == 3 ? argv[2] : NULL, &word, &year, &found);
+    fclose(r.fp);
+
+    if (!ok) {
+        printf(
+            "Error syncing data: line %u: '%s' is not a valid leaderboard.\n",
+            r.line, argv[0]
+        );
+        return;
+    }
+    if (year < 0 || year >= UINT8_MAX) {
+        printf("Error syncing data: '%s' has no valid event year.\n", argv[0]);
+        return;
+    }
+    if (!found) {
+        printf(
+            "Error syncing data: no member matches '%s'.\n",
+            argc == 3 ? argv[2] : ""
+        );
+        return;
+    }
+
+    while (year >= max_year)
+        if (!new_year())
+            return;
+
+    /* completed days override started ones */
+    uint64_t old = WORD(l, year);
+    uint64_t w = old | word;
+    w &= ~((w & DAY_BITS) << 1);
+    WORD(l, year) = w;
+    hist_word(l, year, old, w);
+    if (w != old)
+        undo_push((delta) { U_WORD, 0, l - langs, 0, year, w ^ old, { NULL, NULL } });
+
+    printf(
+        "Synced %d %s: %d newly completed, %d newly started.\n",
+        YEAR(year), l->name,
+        popcount(w & ~old & DAY_BITS), popcount(w & ~old & (DAY_BITS << 1))
+    );
+    if (w != old)
+        serialize();
+}
+
+
+typedef struct {
+    int argc;
+    char **argv;
+} team_show;
+
+
+typedef struct {
+    long langs, completed, started;
+    long years[UINT8_MAX];
+    uint8_t max_year;
+} team_stats;
+
+
+int show_profile(const char *user, const char *path, void *arg) {
+    team_show *t = arg;
+    printf("== %s ==\n\n", user);
+    set_filename(path);
+    cmd_show(t->argc, t->argv);
+    clean_all();
+    return 1;
+}
+
+
+int stats_profile(const char *user, const char *path, void *arg) {
+    team_stats *t = arg;
+    static stream s;
+    long langs = 0, completed = 0, started = 0;
+    int r = 0;
+
+    /* an unreadable profile still gets its (empty) row */
+    if (!stream_open(&s, path)) {
+        printf("Error reading data: '%s' could not be opened.\n", path);
+        s.years = 0;
+    }
+
+    while (s.fp && (r = stream_next(&s)) > 0) {
+        langs++;
+        for (int y = 0; y < s.years; ++y) {
+            uint64_t w = s.words[y];
+            int n = popcount(w & DAY_BITS);
+            completed += n;
+            started += popcount((w >> 1) & ~w & DAY_BITS);
+            t->years[y] += n;
+        }
+    }
+    if (s.fp)
+        fclose(s.fp);
+    if (r < 0)
+        printf("Error reading data: '%s' contains invalid data.\n", path);
+
+    printf("%-24s %10ld %10ld %10ld\n", user, langs, completed, started);
+    t->langs += langs;
+    t->completed += completed;
+    t->started += started;
+    if (s.years > t->max_year)
+        t->max_year = s.years;
+    return 1;
+}
+
+
+void cmd_team(int argc, char **argv) {
+    if (argc && str_eq1(argv[0], "show")) {
+        char saved[PATH_SZ];
+        team_show t = { argc - 1, &argv[1] };
+        strcpy(saved, filename);
+        for_each_profile(show_profile, &t);
+        set_filename(saved);
+    } else if (argc == 1 && str_eq1(argv[0], "stats")) {
+        static team_stats t;
+        memset(&t, 0, sizeof(t));
+        printf("%-24s %10s %10s %10s\n", "profile", "languages", "completed", "started");
+        if (!for_each_profile(stats_profile, &t))
+            return;
+        printf("%-24s %10ld %10ld %10ld\n\n", "total", t.langs, t.completed, t.started);
+        for (int y = 0; y < t.max_year; ++y)
+            printf("%d: %ld completed\n", YEAR(y), t.years[y]);
+    } else
+        printf(
+            "Unknown argument: '%s' (expected 'show' or 'stats').\n",
+            argc ? argv[0] : ""
+        );
+}
+
+
+/* undoes (or redoes) every delta of the last (or next) command */
+void cmd_undo(int redo) {
+    size_t *from = redo ? &redo_len : &undo_len;
+    if (!*from) {
+        printf("Nothing to %s.\n", redo ? "redo" : "undo");
         return;
+    }
 
-    print(tl, ty, td);
+    unsigned step = UNDO_AT(redo ? undo_len : undo_len - 1)->step;
+    int n = 0;
+    undo_replay = 1;
+    while (*from) {
+        delta *d = UNDO_AT(redo ? undo_len : undo_len - 1);
+        if (d->step != step || !undo_apply(d, !redo))
+            break;
+        undo_len += redo ? 1 : -1;
+        redo_len += redo ? -1 : 1;
+        n++;
+    }
+    undo_replay = 0;
+    printf("%s %d change%s.\n", redo ? "Redid" : "Undid", n, n > 1 ? "s" : "");
 }
 
 
@@ -869,22 +4400,40 @@ void dispatch_cmd(int argc, char **argv) {
         || str_eq2(argv[0], "h", "help")
         || str_eq2(argv[0], "-h", "--help"))
         cmd_help();
+    else if (!edit_mode && !strcmp(argv[0], "__complete"))
+        cmd_complete(argc - 1, &argv[1]);
     else if (str_eq1(argv[0], "add"))
         cmd_lang(argc - 1, &argv[1], 1);
     else if (str_eq1(argv[0], "clear"))
         cmd_set(argc - 1, &argv[1], NOT_YET);
     else if (str_eq1(argv[0], "complete"))
         cmd_set(argc - 1, &argv[1], COMPLETED);
+    else if (str_eq1(argv[0], "diff"))
+        cmd_diff(argc - 1, &argv[1]);
     else if (!edit_mode && str_eq1(argv[0], "edit"))
         cmd_edit();
     else if (edit_mode && str_eq1(argv[0], "exit"))
         cmd_exit();
+    else if (str_eq1(argv[0], "export"))
+        cmd_export(argc - 1, &argv[1]);
     else if (str_eq1(argv[0], "file"))
         cmd_file();
     else if (str_eq2(argv[0], "get", "random"))
         cmd_get(argc - 1, &argv[1]);
+    else if (str_eq1(argv[0], "history"))
+        cmd_history(argc - 1, &argv[1]);
+    else if (str_eq1(argv[0], "import"))
+        cmd_import(argc - 1, &argv[1]);
     else if (str_eq1(argv[0], "init"))
         cmd_init();
+    else if (!edit_mode && !strcmp(argv[0], "__kernels"))
+        cmd_kernels();
+    else if (!edit_mode && str_eq1(argv[0], "merge"))
+        cmd_merge(argc - 1, &argv[1]);
+    else if (str_eq1(argv[0], "query"))
+        cmd_query(argc - 1, &argv[1]);
+    else if (edit_mode && str_eq1(argv[0], "redo"))
+        cmd_undo(1);
     else if (edit_mode && str_eq1(argv[0], "reload"))
         cmd_reload();
     else if (str_eq1(argv[0], "rename"))
@@ -897,6 +4446,12 @@ void dispatch_cmd(int argc, char **argv) {
         cmd_set(argc - 1, &argv[1], STARTED);
     else if (str_eq1(argv[0], "show"))
         cmd_show(argc - 1, &argv[1]);
+    else if (str_eq1(argv[0], "sync"))
+        cmd_sync(argc - 1, &argv[1]);
+    else if (!edit_mode && str_eq1(argv[0], "team"))
+        cmd_team(argc - 1, &argv[1]);
+    else if (edit_mode && str_eq1(argv[0], "undo"))
+        cmd_undo(0);
     else if (str_eq1(argv[0], "year"))
         cmd_year(argc - 1, &argv[1]);
     else
@@ -905,7 +4460,17 @@ void dispatch_cmd(int argc, char **argv) {
 
 
 int main(int argc, char **argv) {
-    dispatch_cmd(argc - 1, &argv[1]);
+    const char *user = NULL;
+    if (argc > 2 && str_eq2(argv[1], "-p", "--profile")) {
+        user = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+
+    select_kernels();
+    if (select_profile(user))
+        dispatch_cmd(argc - 1, &argv[1]);
     clean_all();
-    return EXIT_SUCCESS;
+    hist_clear();
+    return exit_status;
 }
\ No newline at end of file
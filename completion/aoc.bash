@@ -0,0 +1,6 @@
+# bash completion for aoc, source this file from ~/.bashrc
+_aoc() {
+    local IFS=$'\n'
+    COMPREPLY=($("${COMP_WORDS[0]}" __complete "${COMP_WORDS[@]:1:COMP_CWORD}" 2>/dev/null))
+}
+complete -o default -F _aoc aoc